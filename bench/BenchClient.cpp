@@ -0,0 +1,324 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "BenchClient.h"
+#include <stdio.h>
+#include <ftw.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <algorithm>
+
+size_t BenchAllocations::count = 0;
+size_t BenchAllocations::bytes = 0;
+
+size_t BenchClient::s_iterations = 0;
+
+const char* const BenchClient::SCENARIO_NAMES[ScenarioCount] = {
+	"run",
+	"scan",
+	"rescan",
+	"unconfigure",
+};
+
+static int RemoveEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+	return remove(path);
+}
+
+BenchClient::BenchClient()
+	: m_generated(false),
+	  m_keepTree(false),
+	  m_timeout(Configurator::DEFAULT_TIMEOUT_MS),
+	  m_retries(Configurator::DEFAULT_RETRIES),
+	  m_batch(false),
+	  m_next(0),
+	  m_counter(NULL),
+	  m_iterations(0),
+	  m_allocations(0),
+	  m_allocatedBytes(0)
+{
+	for (int scenario = RunScenario; scenario < ScenarioCount; scenario++)
+		m_scenarios.push_back((Scenario) scenario);
+}
+
+BenchClient::~BenchClient()
+{
+	if (m_counter) {
+		g_source_destroy(m_counter);
+		g_source_unref(m_counter);
+	}
+
+	// contents first, without following links out of the tree
+	if (m_generated && !m_keepTree && nftw(m_tree.c_str(), &RemoveEntry, 16, FTW_DEPTH | FTW_PHYS) != 0)
+		fprintf(stderr, "failed to remove the generated tree %s\n", m_tree.c_str());
+}
+
+MojErr BenchClient::handleArgs(const StringVec& args)
+{
+	MojErr err = BusClient::handleArgs(args);
+	MojErrCheck(err);
+
+	for (StringVec::const_iterator i = args.begin(); i != args.end(); ++i) {
+		const std::string arg(i->data(), i->length());
+		const size_t separator = arg.find('=');
+		if (separator == std::string::npos)
+			continue;
+
+		err = ParseArg(arg.substr(0, separator), arg.substr(separator + 1));
+		MojErrCheck(err);
+	}
+	return MojErrNone;
+}
+
+MojErr BenchClient::ParseArg(const std::string& key, const std::string& value)
+{
+	BenchService::Profile profile;
+	const unsigned long number = strtoul(value.c_str(), NULL, 10);
+
+	if (key == "tree")
+		m_tree = value;
+	else if (key == "kinds")
+		m_shape.kinds = number;
+	else if (key == "permissions")
+		m_shape.permissions = number;
+	else if (key == "filecache")
+		m_shape.fileCacheTypes = number;
+	else if (key == "activities")
+		m_shape.activities = number;
+	else if (key == "owners")
+		m_shape.owners = number;
+	else if (key == "apps")
+		m_shape.apps = number;
+	else if (key == "appconfigs")
+		m_shape.appConfigs = number;
+	else if (key == "timeout")
+		m_timeout = std::min<unsigned long>(number, Configurator::MAX_TIMEOUT_MS);
+	else if (key == "retries")
+		m_retries = std::min<unsigned long>(number, Configurator::MAX_RETRIES);
+	else if (key == "batch")
+		m_batch = number != 0;
+	else if (key == "keep")
+		m_keepTree = number != 0;
+	else if (key == "seed")
+		m_bench.SetSeed(number);
+	else if (key == "scenarios") {
+		if (!ParseScenarios(value, m_scenarios))
+			MojErrThrowMsg(MojErrInvalidArg, "unrecognized scenario in '%s'", value.c_str());
+	} else if (key == "service") {
+		std::string service;
+		if (!ParseProfile(value, service, profile))
+			MojErrThrowMsg(MojErrInvalidArg, "bad service profile '%s'", value.c_str());
+		m_bench.SetProfile(service, profile);
+	} else if (key == "latency" || key == "jitter" || key == "errors" || key == "drops") {
+		if (key == "latency")
+			m_defaults.latencyMs = number;
+		else if (key == "jitter")
+			m_defaults.jitterMs = number;
+		else if (key == "errors")
+			m_defaults.errorRate = strtod(value.c_str(), NULL);
+		else
+			m_defaults.dropRate = strtod(value.c_str(), NULL);
+		m_bench.SetDefaultProfile(m_defaults);
+	} else {
+		MojErrThrowMsg(MojErrInvalidArg, "unrecognized argument '%s'", key.c_str());
+	}
+	return MojErrNone;
+}
+
+bool BenchClient::ParseProfile(const std::string& spec, std::string& service, BenchService::Profile& profile)
+{
+	std::vector<std::string> fields;
+	for (size_t start = 0; ; ) {
+		const size_t end = spec.find(',', start);
+		fields.push_back(spec.substr(start, end == std::string::npos ? std::string::npos : end - start));
+		if (end == std::string::npos)
+			break;
+		start = end + 1;
+	}
+	if (fields.size() < 3 || fields.size() > 5 || fields[0].empty())
+		return false;
+
+	service = fields[0];
+	profile.latencyMs = strtoul(fields[1].c_str(), NULL, 10);
+	profile.jitterMs = strtoul(fields[2].c_str(), NULL, 10);
+	if (fields.size() > 3)
+		profile.errorRate = strtod(fields[3].c_str(), NULL);
+	if (fields.size() > 4)
+		profile.dropRate = strtod(fields[4].c_str(), NULL);
+	return true;
+}
+
+bool BenchClient::ParseScenarios(const std::string& list, std::vector<Scenario>& scenarios)
+{
+	scenarios.clear();
+	for (size_t start = 0; start <= list.length(); ) {
+		size_t end = list.find(',', start);
+		if (end == std::string::npos)
+			end = list.length();
+		const std::string name = list.substr(start, end - start);
+
+		int scenario = RunScenario;
+		while (scenario < ScenarioCount && name != SCENARIO_NAMES[scenario])
+			scenario++;
+		if (scenario == ScenarioCount)
+			return false;
+		scenarios.push_back((Scenario) scenario);
+		start = end + 1;
+	}
+	return !scenarios.empty();
+}
+
+MojErr BenchClient::open()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	// no bus - BusClient::open() would register the service
+	MojErr err = Base::open();
+	MojErrCheck(err);
+
+	if (m_tree.empty()) {
+		char root[] = "/tmp/configurator-bench-XXXXXX";
+		if (mkdtemp(root) == NULL)
+			MojErrThrowMsg(MojErrInternal, "failed to create a directory for the tree");
+		m_tree = root;
+		// removed again on exit even if generating it fails halfway
+		m_generated = true;
+		if (!BenchTree::Generate(m_tree, m_shape, m_apps))
+			MojErrThrowMsg(MojErrInternal, "failed to generate the tree in %s", m_tree.c_str());
+	} else {
+		BenchTree::FindApps(m_tree, m_apps);
+	}
+	m_root = m_tree;
+	m_stampIndex.Load();
+	m_bootStamps.Load();
+	m_firstUseIndex.Load();
+
+	printf("tree %s (%s), %zu applications\n", m_tree.c_str(), m_generated ? "generated" : "replayed", m_apps.size());
+
+	// prepare is called once per main loop iteration
+	static GSourceFuncs counterFuncs = { &BenchClient::CountIteration, &BenchClient::NeverReady, &BenchClient::NoDispatch, NULL };
+	m_counter = g_source_new(&counterFuncs, sizeof(GSource));
+	g_source_attach(m_counter, NULL);
+
+	g_idle_add(&BenchClient::StartCallback, this);
+	return MojErrNone;
+}
+
+MojRefCountedPtr<MojServiceRequest> BenchClient::CreateRequest()
+{
+	MojRefCountedPtr<MojServiceRequest> req;
+	m_bench.createRequest(req);
+	return req;
+}
+
+MojRefCountedPtr<MojServiceRequest> BenchClient::CreateRequest(const char *forgedAppId)
+{
+	MojRefCountedPtr<MojServiceRequest> req;
+	m_bench.createRequest(req, forgedAppId);
+	return req;
+}
+
+void BenchClient::StartScenario()
+{
+	const Scenario scenario = m_scenarios[m_next];
+	LOG_DEBUG("Starting scenario %s", SCENARIO_NAMES[scenario]);
+
+	AbortShutdown();
+	ClearConfigurators();
+	m_stats.Reset();
+	m_bench.ResetCounts();
+
+	// the run parameters only last for one run
+	m_requestTimeout = m_timeout;
+	m_requestRetries = m_retries;
+	m_batchPermissions = m_batch;
+	m_busy = true;
+
+	m_iterations = s_iterations;
+	m_allocations = BenchAllocations::count;
+	m_allocatedBytes = BenchAllocations::bytes;
+	m_timer = ConfiguratorStats::Timer();
+
+	if (scenario == RunScenario) {
+		Run(DBKINDS | DBPERMISSIONS | FILECACHE | ACTIVITIES);
+	} else {
+		for (BenchTree::Ids::const_iterator i = m_apps.begin(); i != m_apps.end(); ++i) {
+			MojString id;
+			id.assign(i->c_str());
+			if (scenario == ScanScenario)
+				Scan(LazyScan, id, Application, System);
+			else if (scenario == RescanScenario)
+				Scan(ForceRescan, id, Application, System);
+			else
+				Unconfigure(id, Application, System, DBKINDS | DBPERMISSIONS | FILECACHE | ACTIVITIES);
+		}
+	}
+	RunNextConfigurator();
+}
+
+void BenchClient::RunFinished()
+{
+	if (m_next >= m_scenarios.size())
+		return;
+
+	Sample sample;
+	sample.wallUs = m_timer.Elapsed();
+	sample.iterations = s_iterations - m_iterations;
+	sample.allocations = BenchAllocations::count - m_allocations;
+	sample.allocatedBytes = BenchAllocations::bytes - m_allocatedBytes;
+
+	struct rusage usage;
+	sample.peakRssKb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1;
+
+	Report(m_scenarios[m_next], sample);
+
+	// the shutdown scheduled after the last one ends the bench
+	if (++m_next < m_scenarios.size())
+		g_idle_add(&BenchClient::StartCallback, this);
+}
+
+void BenchClient::Report(Scenario scenario, const Sample& sample) const
+{
+	printf("%-12s %9.1f ms %8zu iterations %9zu allocations (%zu KiB) peak RSS %ld KiB | "
+			"%zu sent, %zu skipped | bus: %zu requests, %zu failed, %zu dropped\n",
+			SCENARIO_NAMES[scenario], sample.wallUs / 1000.0, sample.iterations,
+			sample.allocations, sample.allocatedBytes / 1024, sample.peakRssKb,
+			Configurator::ConfigsSent(), Configurator::ConfigsSkipped(),
+			m_bench.Sent(), m_bench.Failed(), m_bench.Dropped());
+	fflush(stdout);
+}
+
+gboolean BenchClient::StartCallback(gpointer data)
+{
+	static_cast<BenchClient*>(data)->StartScenario();
+	return FALSE;
+}
+
+gboolean BenchClient::CountIteration(GSource*, gint* timeout)
+{
+	s_iterations++;
+	*timeout = -1;
+	return FALSE;
+}
+
+gboolean BenchClient::NeverReady(GSource*)
+{
+	return FALSE;
+}
+
+gboolean BenchClient::NoDispatch(GSource*, GSourceFunc, gpointer)
+{
+	return TRUE;
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef BENCHCLIENT_H_
+#define BENCHCLIENT_H_
+
+#include "BusClient.h"
+#include "BenchService.h"
+#include "BenchTree.h"
+#include <string>
+#include <vector>
+
+// counted by the operator new of the bench (BenchMain.cpp)
+struct BenchAllocations
+{
+	static size_t count;
+	static size_t bytes;
+};
+
+/**
+ * Runs the configurators against BenchService instead of the bus and
+ * reports what each scenario cost: wall time from the first configurator
+ * to the reply, main loop iterations, allocations and the peak RSS of the
+ * process so far.
+ *
+ * Arguments (key=value):
+ *   tree=<dir>         replay an existing tree instead of generating one
+ *   keep=1             leave the generated tree behind (removed on exit
+ *                      by default)
+ *   kinds=, permissions=, filecache=, activities=, owners=, apps=,
+ *   appconfigs=        shape of the generated tree (see BenchTree::Shape)
+ *   scenarios=<list>   comma separated run, scan, rescan and unconfigure
+ *                      (default: all of them, in that order)
+ *   latency=, jitter=  milliseconds a reply takes by default
+ *   errors=, drops=    rate of failed and lost replies by default
+ *   service=<name>,<latency>,<jitter>[,<errors>[,<drops>]]
+ *                      profile of a single service
+ *   timeout=, retries=, batch=1
+ *                      as in the run method
+ *   seed=<n>           for the latency and error rolls
+ */
+class BenchClient : public BusClient
+{
+public:
+	BenchClient();
+	virtual ~BenchClient();
+
+	virtual MojErr open();
+	virtual MojErr handleArgs(const StringVec& args);
+
+	virtual MojRefCountedPtr<MojServiceRequest> CreateRequest();
+	virtual MojRefCountedPtr<MojServiceRequest> CreateRequest(const char *forgedAppId);
+
+protected:
+	virtual void RunFinished();
+
+private:
+	enum Scenario {
+		RunScenario,
+		ScanScenario,
+		RescanScenario,
+		UnconfigureScenario,
+		ScenarioCount
+	};
+
+	struct Sample {
+		gint64 wallUs;
+		size_t iterations;
+		size_t allocations;
+		size_t allocatedBytes;
+		long   peakRssKb;
+	};
+
+	static const char* const SCENARIO_NAMES[ScenarioCount];
+
+	MojErr ParseArg(const std::string& key, const std::string& value);
+	static bool ParseProfile(const std::string& spec, std::string& service, BenchService::Profile& profile);
+	static bool ParseScenarios(const std::string& list, std::vector<Scenario>& scenarios);
+
+	void StartScenario();
+	void Report(Scenario scenario, const Sample& sample) const;
+
+	static gboolean StartCallback(gpointer data);
+	static gboolean CountIteration(GSource* source, gint* timeout);
+	static gboolean NeverReady(GSource* source);
+	static gboolean NoDispatch(GSource* source, GSourceFunc callback, gpointer data);
+
+	static size_t s_iterations;
+
+	BenchService m_bench;
+	BenchService::Profile m_defaults;
+	BenchTree::Shape m_shape;
+	BenchTree::Ids m_apps;
+	std::string m_tree;
+	bool m_generated;
+	bool m_keepTree;
+	guint m_timeout;
+	unsigned m_retries;
+	bool m_batch;
+	std::vector<Scenario> m_scenarios;
+	size_t m_next;
+	GSource *m_counter;
+
+	// at the start of the scenario in progress
+	ConfiguratorStats::Timer m_timer;
+	size_t m_iterations;
+	size_t m_allocations;
+	size_t m_allocatedBytes;
+};
+
+#endif /* BENCHCLIENT_H_ */
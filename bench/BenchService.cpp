@@ -0,0 +1,208 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "BenchService.h"
+#include "Log.h"
+
+BenchService::Profile::Profile()
+	: latencyMs(2),
+	  jitterMs(1),
+	  errorRate(0),
+	  dropRate(0)
+{
+}
+
+BenchService::Request::Request(BenchService* service)
+	: MojServiceRequest(service)
+{
+}
+
+MojObjectVisitor& BenchService::Request::writer()
+{
+	return m_builder;
+}
+
+const MojObject& BenchService::Request::Payload() const
+{
+	return m_builder.object();
+}
+
+BenchService::BenchService()
+	: m_rand(g_rand_new_with_seed(1)),
+	  m_nextToken(0),
+	  m_sent(0),
+	  m_failed(0),
+	  m_dropped(0)
+{
+}
+
+BenchService::~BenchService()
+{
+	for (ReplyMap::iterator i = m_replies.begin(); i != m_replies.end(); ++i) {
+		g_source_remove(i->second->source);
+		delete i->second;
+	}
+	g_rand_free(m_rand);
+}
+
+void BenchService::SetSeed(guint32 seed)
+{
+	g_rand_set_seed(m_rand, seed);
+}
+
+void BenchService::SetDefaultProfile(const Profile& profile)
+{
+	m_default = profile;
+}
+
+void BenchService::SetProfile(const std::string& service, const Profile& profile)
+{
+	m_profiles[service] = profile;
+}
+
+void BenchService::ResetCounts()
+{
+	m_sent = 0;
+	m_failed = 0;
+	m_dropped = 0;
+}
+
+const BenchService::Profile& BenchService::Lookup(const std::string& service) const
+{
+	ProfileMap::const_iterator i = m_profiles.find(service);
+	return i == m_profiles.end() ? m_default : i->second;
+}
+
+MojErr BenchService::open(const MojChar*)
+{
+	return MojErrNone;
+}
+
+MojErr BenchService::close()
+{
+	return MojErrNone;
+}
+
+MojErr BenchService::dispatch()
+{
+	return MojErrNone;
+}
+
+MojErr BenchService::createRequest(MojRefCountedPtr<MojServiceRequest>& reqOut)
+{
+	reqOut.reset(new Request(this));
+	MojAllocCheck(reqOut.get());
+	return MojErrNone;
+}
+
+MojErr BenchService::createRequest(MojRefCountedPtr<MojServiceRequest>& reqOut, bool)
+{
+	return createRequest(reqOut);
+}
+
+MojErr BenchService::createRequest(MojRefCountedPtr<MojServiceRequest>& reqOut, bool, const MojString&)
+{
+	return createRequest(reqOut);
+}
+
+MojErr BenchService::createRequest(MojRefCountedPtr<MojServiceRequest>& reqOut, const char*)
+{
+	return createRequest(reqOut);
+}
+
+MojErr BenchService::BuildReply(const std::string& method, const MojObject& params, bool failed, MojObject& reply) const
+{
+	MojErr err;
+	if (failed) {
+		err = reply.putBool("returnValue", false);
+		MojErrCheck(err);
+		err = reply.putInt("errorCode", -1);
+		MojErrCheck(err);
+		return reply.putString("errorText", "injected failure");
+	}
+
+	return reply.putBool("returnValue", true);
+}
+
+MojErr BenchService::sendImpl(MojServiceRequest* req, const MojChar* service, const MojChar* method, Token& tokenOut)
+{
+	tokenOut = ++m_nextToken;
+	m_sent++;
+
+	const Profile& profile = Lookup(service);
+	if (g_rand_double(m_rand) < profile.dropRate) {
+		m_dropped++;
+		return MojErrNone;
+	}
+
+	const bool failed = g_rand_double(m_rand) < profile.errorRate;
+	if (failed)
+		m_failed++;
+
+	Reply *reply = new Reply;
+	MojAllocCheck(reply);
+	reply->service = this;
+	reply->request.reset(req);
+	MojErr err = BuildReply(method, static_cast<Request*>(req)->Payload(), failed, reply->payload);
+	if (err) {
+		delete reply;
+		MojErrThrow(err);
+	}
+
+	guint delay = profile.latencyMs;
+	if (profile.jitterMs)
+		delay += g_rand_int_range(m_rand, 0, profile.jitterMs + 1);
+	reply->source = g_timeout_add(delay, &BenchService::ReplyCallback, reply);
+	m_replies[req] = reply;
+	return MojErrNone;
+}
+
+MojErr BenchService::cancelImpl(MojServiceRequest* req)
+{
+	ReplyMap::iterator i = m_replies.find(req);
+	if (i == m_replies.end())
+		return MojErrNone;
+
+	g_source_remove(i->second->source);
+	delete i->second;
+	m_replies.erase(i);
+	return MojErrNone;
+}
+
+MojErr BenchService::enableSubscriptionImpl(MojServiceMessage*)
+{
+	return MojErrNone;
+}
+
+MojErr BenchService::removeSubscriptionImpl(MojServiceMessage*)
+{
+	return MojErrNone;
+}
+
+gboolean BenchService::ReplyCallback(gpointer data)
+{
+	Reply *reply = static_cast<Reply*>(data);
+	BenchService *service = reply->service;
+	service->m_replies.erase(reply->request.get());
+
+	MojErr err = service->dispatchReply(reply->request.get(), NULL, reply->payload, MojErrNone);
+	if (err) {
+		LOG_WARNING(MSGID_BUS_CLIENT_ERROR, 1,
+				PMLOGKFV("error", "%d", err),
+				"Dispatching a bench reply failed (%d)", err);
+	}
+	delete reply;
+	return FALSE;
+}
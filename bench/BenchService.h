@@ -0,0 +1,109 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef BENCHSERVICE_H_
+#define BENCHSERVICE_H_
+
+#include "core/MojService.h"
+#include "core/MojServiceRequest.h"
+#include "core/MojObjectBuilder.h"
+#include <glib.h>
+#include <map>
+#include <string>
+
+/**
+ * Stands in for the bus when benchmarking: requests are answered from a
+ * timer after the latency configured for their target service (plus up to
+ * jitter), and fail or never get a reply at the configured rates.
+ *
+ * The random numbers come from a fixed seed so runs with the same
+ * settings are comparable.  Only used from the main loop.
+ */
+class BenchService : public MojService
+{
+public:
+	struct Profile {
+		Profile();
+
+		guint  latencyMs;
+		guint  jitterMs;
+		double errorRate; // replies with returnValue false
+		double dropRate;  // no reply at all
+	};
+
+	BenchService();
+	virtual ~BenchService();
+
+	void SetSeed(guint32 seed);
+
+	void SetDefaultProfile(const Profile& profile);
+	void SetProfile(const std::string& service, const Profile& profile);
+
+	size_t Sent() const { return m_sent; }
+	size_t Failed() const { return m_failed; }
+	size_t Dropped() const { return m_dropped; }
+	void   ResetCounts();
+
+	virtual MojErr open(const MojChar* serviceName);
+	virtual MojErr close();
+	virtual MojErr dispatch();
+	virtual MojErr createRequest(MojRefCountedPtr<MojServiceRequest>& reqOut);
+	virtual MojErr createRequest(MojRefCountedPtr<MojServiceRequest>& reqOut, bool onPublic);
+	virtual MojErr createRequest(MojRefCountedPtr<MojServiceRequest>& reqOut, bool onPublic, const MojString& proxyRequester);
+	virtual MojErr createRequest(MojRefCountedPtr<MojServiceRequest>& reqOut, const char* proxyRequester);
+
+protected:
+	virtual MojErr sendImpl(MojServiceRequest* req, const MojChar* service, const MojChar* method, Token& tokenOut);
+	virtual MojErr cancelImpl(MojServiceRequest* req);
+	virtual MojErr enableSubscriptionImpl(MojServiceMessage* msg);
+	virtual MojErr removeSubscriptionImpl(MojServiceMessage* msg);
+
+private:
+	class Request : public MojServiceRequest
+	{
+	public:
+		Request(BenchService* service);
+		virtual MojObjectVisitor& writer();
+		const MojObject& Payload() const;
+
+	private:
+		MojObjectBuilder m_builder;
+	};
+
+	struct Reply {
+		BenchService *service;
+		MojRefCountedPtr<MojServiceRequest> request;
+		MojObject payload;
+		guint source;
+	};
+	typedef std::map<MojServiceRequest*, Reply*> ReplyMap;
+	typedef std::map<std::string, Profile> ProfileMap;
+
+	const Profile& Lookup(const std::string& service) const;
+	MojErr BuildReply(const std::string& method, const MojObject& params, bool failed, MojObject& reply) const;
+
+	static gboolean ReplyCallback(gpointer data);
+
+	GRand *m_rand;
+	Profile m_default;
+	ProfileMap m_profiles;
+	ReplyMap m_replies;
+	Token m_nextToken;
+	size_t m_sent;
+	size_t m_failed;
+	size_t m_dropped;
+};
+
+#endif /* BENCHSERVICE_H_ */
@@ -0,0 +1,161 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+#include "BenchTree.h"
+#include "Log.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+const char* const BenchTree::APPS_DIR = "/usr/palm/applications/";
+
+BenchTree::Shape::Shape()
+	: kinds(500),
+	  permissions(500),
+	  fileCacheTypes(50),
+	  activities(100),
+	  owners(50),
+	  apps(20),
+	  appConfigs(4)
+{
+}
+
+static bool MakeDirs(const std::string& path)
+{
+	for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+		const std::string dir = path.substr(0, pos);
+		if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+			return false;
+		if (pos == std::string::npos)
+			return true;
+	}
+}
+
+bool BenchTree::Write(const std::string& path, const std::string& content)
+{
+	if (!MakeDirs(path.substr(0, path.rfind('/'))))
+		return false;
+
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL)
+		return false;
+	const bool written = fwrite(content.data(), 1, content.length(), file) == content.length();
+	return fclose(file) == 0 && written;
+}
+
+static std::string Number(size_t n)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%zu", n);
+	return buffer;
+}
+
+static std::string KindId(const std::string& owner, const std::string& prefix, size_t n)
+{
+	return owner + "." + prefix + "kind" + Number(n) + ":1";
+}
+
+bool BenchTree::WriteConfigs(const std::string& baseDir, const std::string& prefix, size_t count, size_t owners, const std::string& appId)
+{
+	for (size_t i = 0; i < count; i++) {
+		// system configs go into the directory of their owner, those of an
+		// application are owned by it
+		const std::string owner = appId.empty() ? "com.bench.owner" + Number(i % owners) : appId;
+		const std::string dir = appId.empty() ? owner + "/" : "";
+		const std::string kind = KindId(owner, prefix, i);
+
+		bool ok = Write(baseDir + "db/kinds/" + dir + prefix + "kind" + Number(i),
+				"{\"id\":\"" + kind + "\",\"owner\":\"" + owner + "\","
+				"\"indexes\":[{\"name\":\"name\",\"props\":[{\"name\":\"name\"}]}]}");
+		ok = ok && Write(baseDir + "db/permissions/" + dir + prefix + "kind" + Number(i),
+				"[{\"type\":\"db.kind\",\"object\":\"" + kind + "\",\"caller\":\"" + owner + "\","
+				"\"operations\":{\"read\":\"allow\",\"create\":\"allow\",\"update\":\"allow\",\"delete\":\"allow\"}}]");
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+bool BenchTree::Generate(const std::string& root, const Shape& shape, Ids& apps)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	const std::string system = root + "/etc/palm/";
+	const size_t owners = shape.owners ? shape.owners : 1;
+
+	// kinds and their permissions come in pairs - any permissions beyond the
+	// kinds refer to kinds registered earlier
+	if (!WriteConfigs(system, "", shape.kinds, owners, ""))
+		return false;
+	for (size_t i = shape.kinds; i < shape.permissions; i++) {
+		const std::string owner = "com.bench.owner" + Number(i % owners);
+		if (!Write(system + "db/permissions/" + owner + "/extra" + Number(i),
+				"[{\"type\":\"db.kind\",\"object\":\"" + KindId(owner, "extra", i) + "\",\"caller\":\"" + owner + "\","
+				"\"operations\":{\"read\":\"allow\"}}]"))
+			return false;
+	}
+
+	for (size_t i = 0; i < shape.fileCacheTypes; i++) {
+		const std::string owner = "com.bench.owner" + Number(i % owners);
+		if (!Write(system + "filecache_types/" + owner + "/type" + Number(i),
+				"{\"typeName\":\"" + owner + ".type" + Number(i) + "\",\"loWatermark\":50000,\"hiWatermark\":100000}"))
+			return false;
+	}
+
+	for (size_t i = 0; i < shape.activities; i++) {
+		const std::string owner = "com.bench.owner" + Number(i % owners);
+		if (!Write(system + "activities/" + owner + "/activity" + Number(i),
+				"{\"activity\":{\"name\":\"" + owner + ".activity" + Number(i) + "\",\"type\":{\"persist\":true},"
+				"\"callback\":{\"method\":\"palm://" + owner + "/run\"}},\"start\":true,\"replace\":true}"))
+			return false;
+	}
+
+	apps.clear();
+	for (size_t i = 0; i < shape.apps; i++) {
+		const std::string id = "com.bench.app" + Number(i);
+		const std::string conf = root + APPS_DIR + id + "/configuration/";
+		if (!WriteConfigs(conf, "app", shape.appConfigs, 1, id))
+			return false;
+		for (size_t j = 0; j < shape.appConfigs; j++) {
+			if (!Write(conf + "filecache_types/type" + Number(j),
+					"{\"typeName\":\"" + id + ".type" + Number(j) + "\",\"loWatermark\":50000,\"hiWatermark\":100000}"))
+				return false;
+			if (!Write(conf + "activities/activity" + Number(j),
+					"{\"activity\":{\"name\":\"" + id + ".activity" + Number(j) + "\",\"type\":{\"persist\":true},"
+					"\"callback\":{\"method\":\"palm://" + id + "/run\"}},\"start\":true,\"replace\":true}"))
+				return false;
+		}
+		apps.push_back(id);
+	}
+	return true;
+}
+
+void BenchTree::FindApps(const std::string& root, Ids& apps)
+{
+	apps.clear();
+	const std::string dir = root + APPS_DIR;
+	DIR *dp = opendir(dir.c_str());
+	if (dp == NULL)
+		return;
+
+	struct dirent *dirp;
+	while ((dirp = readdir(dp)) != NULL) {
+		if (dirp->d_name[0] != '.')
+			apps.push_back(dirp->d_name);
+	}
+	closedir(dp);
+}
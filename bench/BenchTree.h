@@ -0,0 +1,59 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+#ifndef BENCHTREE_H_
+#define BENCHTREE_H_
+
+#include <string>
+#include <vector>
+
+/**
+ * Writes a synthetic configuration tree below a root directory, laid out
+ * like a device: the system configs below etc/palm/ (one subdirectory per
+ * owner) and a number of applications below usr/palm/applications/, each
+ * with a few configs of every type.
+ *
+ * Permissions refer to the kinds of the same tree, so the runs exercise
+ * the ordering between the two as well.
+ */
+class BenchTree
+{
+public:
+	struct Shape {
+		Shape();
+
+		size_t kinds;
+		size_t permissions;
+		size_t fileCacheTypes;
+		size_t activities;
+		size_t owners;      // owner directories the system configs are spread over
+		size_t apps;
+		size_t appConfigs;  // of every type, per application
+	};
+	typedef std::vector<std::string> Ids;
+
+	static bool Generate(const std::string& root, const Shape& shape, Ids& apps);
+
+	// the application ids found in an existing tree
+	static void FindApps(const std::string& root, Ids& apps);
+
+	static const char* const APPS_DIR;
+
+private:
+	static bool Write(const std::string& path, const std::string& content);
+	static bool WriteConfigs(const std::string& baseDir, const std::string& prefix, size_t count, size_t owners, const std::string& appId);
+};
+
+#endif /* BENCHTREE_H_ */
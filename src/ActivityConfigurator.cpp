@@ -37,6 +37,7 @@ const char* const ActivityConfigurator::APP_DIR		  = "/etc/palm/activities/appli
 const char* const ActivityConfigurator::SERVICE_DIR		  = "/etc/palm/activities/services/";
 const char* const ActivityConfigurator::FIRST_USE_FLAG    = "/var/luna/preferences/ran-first-use";
 const char* const ActivityConfigurator::FIRST_USE_PROFILE_FLAG = "/var/luna/preferences/first-use-profile-created";
+const size_t ActivityConfigurator::ACTIVITYMGR_INFLIGHT_WINDOW = 4;
 
 class ActivityConfigureResponse : public ConfiguratorCallback {
 public:
@@ -58,7 +59,7 @@ public:
 			MojInt64 errorCode;
 			if (response.get("errorCode", errorCode)) {
 				if (errorCode == MojErrExists) {
-					LOG_DEBUG("caching ok negative response for %s", m_config.c_str());
+					LOG_DEBUG("caching ok negative response for %s", ConfigPath().c_str());
 					bool found = false;
 					response.del("errorCode", found);
 					response.del("errorText", found);
@@ -87,6 +88,11 @@ const char* ActivityConfigurator::ServiceName() const
 	return ACTIVITYMGR_BUS_ADDRESS;
 }
 
+size_t ActivityConfigurator::DefaultInFlightWindow() const
+{
+	return ACTIVITYMGR_INFLIGHT_WINDOW;
+}
+
 ConfiguratorCallback* ActivityConfigurator::CreateCallback(const std::string &filePath)
 {
 	return new ActivityConfigureResponse(this, filePath);
@@ -94,7 +100,9 @@ ConfiguratorCallback* ActivityConfigurator::CreateCallback(const std::string &fi
 
 ActivityConfigurator::ActivityConfigurator(const std::string& id, ConfigType confType, RunType type, BusClient& busClient, string configDirectory)
 	: Configurator(id, confType, type, busClient, configDirectory),
-	  m_firstUseOnly(true)
+	  m_firstUseOnly(true),
+	  m_creatorType(ConfigUnknown),
+	  m_removal(MojObject::TypeObject)
 {
 	int err;
 	struct stat buf;
@@ -123,6 +131,22 @@ bool ActivityConfigurator::CanCacheConfiguratorStatus(const std::string&) const
 	return false;
 }
 
+bool ActivityConfigurator::CachesPerBoot() const
+{
+	return true;
+}
+
+MojErr ActivityConfigurator::PrecheckConfig(const std::string& filePath)
+{
+	// what earlier triggers during this boot found out
+	const unsigned states = m_busClient.GetFirstUseIndex().Lookup(filePath);
+	if (m_firstUseOnly && (states & FirstUseIndex::Deferred)) {
+		LOG_DEBUG("Activity %s still waits for first use", filePath.c_str());
+		return MojErrInProgress;
+	}
+	return MojErrNone;
+}
+
 static void RemoveKey(MojObject& object, const MojChar *key)
 {
 	bool keydeleted;
@@ -149,6 +173,7 @@ MojErr ActivityConfigurator::ProcessConfig(const string& filePath, MojObject& pa
 		bool firstUseSafe;
 		if (!params.get(FIRST_USE_SAFE, firstUseSafe) || !firstUseSafe) {
 			LOG_DEBUG("Running before first use but activity %s not marked as safe for configuration at this time", filePath.c_str());
+			m_busClient.GetFirstUseIndex().Record(filePath, FirstUseIndex::Deferred);
 			return MojErrInProgress;
 		}
 	}
@@ -176,23 +201,30 @@ MojErr ActivityConfigurator::ProcessConfig(const string& filePath, MojObject& pa
 		confType = m_confType;
 	}
 
-	MojObject creatorObj;
-	switch (confType) {
-	case ConfigApplication:
-		err = creatorObj.putString(APPLICATION_ID, creator.c_str());
-		break;
-	case ConfigService:
-		err = creatorObj.putString(SERVICE_ID, creator.c_str());
-		break;
-	case ConfigUnknown:
-		// impossible case
-		assert(false);
-		break;
-	}
+	// the activities of an app or service come one after the other
+	if (creator != m_creatorId || confType != m_creatorType) {
+		MojObject creatorObj;
+		switch (confType) {
+		case ConfigApplication:
+			err = creatorObj.putString(APPLICATION_ID, creator.c_str());
+			break;
+		case ConfigService:
+			err = creatorObj.putString(SERVICE_ID, creator.c_str());
+			break;
+		case ConfigUnknown:
+			// impossible case
+			assert(false);
+			break;
+		}
 
-	MojErrCheck(err);
+		MojErrCheck(err);
+
+		m_creator.swap(creatorObj);
+		m_creatorId = creator;
+		m_creatorType = confType;
+	}
 
-	err = activity.put(CREATOR, creatorObj);
+	err = activity.put(CREATOR, m_creator);
 	MojErrCheck(err);
 	err = params.put(ACTIVITY, activity);
 	MojErrCheck(err);
@@ -215,7 +247,6 @@ MojErr ActivityConfigurator::ProcessConfigRemoval(const string& filePath, MojObj
 	err = params.getRequired(ACTIVITY, activity); MojErrCheck(err);
 	err = activity.getRequired(NAME, activityName); MojErrCheck(err);
 
-	MojObject request(MojObject::TypeObject);
 	const std::string& creator = ParentId(filePath);
 
 	if (creator.empty()) {
@@ -224,9 +255,9 @@ MojErr ActivityConfigurator::ProcessConfigRemoval(const string& filePath, MojObj
 	}
 
 	// {"activityName": "..."}
-	err = request.putString(ACTIVITY_NAME, activityName); MojErrCheck(err);
+	err = m_removal.putString(ACTIVITY_NAME, activityName); MojErrCheck(err);
 	// {"activityName": "...", "creator": "..."}
-	err = request.putString(CREATOR, creator.c_str()); MojErrCheck(err);
+	err = m_removal.putString(CREATOR, creator.c_str()); MojErrCheck(err);
 
-	return m_busClient.CreateRequest()->send(CreateCallback(filePath)->m_slot, ServiceName(), ACTIVITYMGR_REMOVE_METHOD, request);
+	return m_busClient.CreateRequest()->send(CreateCallback(filePath)->m_slot, ServiceName(), ACTIVITYMGR_REMOVE_METHOD, m_removal);
 }
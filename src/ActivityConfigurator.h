@@ -31,8 +31,11 @@ protected:
 
 	virtual const char* ConfiguratorName() const;
 	virtual const char* ServiceName() const;
+	virtual size_t DefaultInFlightWindow() const;
 	virtual ConfiguratorCallback* CreateCallback(const std::string &filePath);
 	virtual bool CanCacheConfiguratorStatus(const std::string &confFile) const;
+	virtual bool CachesPerBoot() const;
+	virtual MojErr PrecheckConfig(const std::string& filePath);
 
 private:
 	static const char* const ACTIVITYMGR_BUS_ADDRESS;
@@ -49,9 +52,17 @@ private:
 	static const char* const SERVICE_DIR;
 	static const char* const FIRST_USE_FLAG;
 	static const char* const FIRST_USE_PROFILE_FLAG;
+	static const size_t ACTIVITYMGR_INFLIGHT_WINDOW;
 
 	bool m_firstUseOnly;
 
+	// reused from one config to the next - the payloads are serialized as
+	// they are sent
+	MojObject m_creator;
+	std::string m_creatorId;
+	ConfigType m_creatorType;
+	MojObject m_removal;
+
 	friend class ActivityConfigureResponse;
 };
 
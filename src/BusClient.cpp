@@ -38,6 +38,8 @@
 #include "FileCacheConfigurator.h"
 
 #include <algorithm>
+#include <malloc.h>
+#include <stdlib.h>
 
 using namespace std;
 
@@ -60,11 +62,23 @@ const char* const BusClient::APPS_DIR                    = "applications/";
 const char* const BusClient::SERVICES_DIR                = "services/";
 const char* const BusClient::CONF_SUBDIR                 = "/configuration/";
 
-int main(int argc, char** argv)
-{
-	BusClient app;
-	return app.main(argc, argv);
-}
+const char* const BusClient::CONFIG_DIRS[] = {
+	OLD_DB_KIND_DIR,
+	DB_KIND_DIR,
+	DB_PERMISSIONS_DIR,
+	MEDIADB_KIND_DIR,
+	MEDIADB_PERMISSIONS_DIR,
+	TEMPDB_KIND_DIR,
+	TEMPDB_PERMISSIONS_DIR,
+	FILE_CACHE_CONFIG_DIR,
+	ACTIVITY_CONFIG_DIR,
+};
+const size_t BusClient::CONFIG_DIR_COUNT = sizeof(CONFIG_DIRS) / sizeof(CONFIG_DIRS[0]);
+const int BusClient::SCAN_WORKERS                        = 3;
+const gint64 BusClient::RUN_SLICE_US                     = 10000;
+const guint BusClient::DEADLINE_CHECK_MS                  = 250;
+const guint BusClient::COUNTERS_INTERVAL_MS               = 1000;
+const guint BusClient::IDLE_TRIM_MIN_MS                   = 2000;
 
 static inline bool startsWith(const char *str, const std::string& prefix)
 {
@@ -91,6 +105,25 @@ BusClient::BusMethods::BusMethods(BusClient& client)
 	err = addMethod("unconfigure", (Callback) &BusMethods::Unconfigure);
 	if (err)
 		LOG_CRITICAL(MSGID_BUS_CLIENT_ERROR, 0, "failed to register unconfigure method: %i", err);
+
+	err = addMethod("getStats", (Callback) &BusMethods::GetStats);
+	if (err)
+		LOG_CRITICAL(MSGID_BUS_CLIENT_ERROR, 0, "failed to register getStats method: %i", err);
+}
+
+static bool getType(const MojString& type, BusClient::ScanType &scanType)
+{
+	if (type == "dbkinds")
+		scanType = BusClient::DBKINDS;
+	else if (type == "dbpermissions")
+		scanType = BusClient::DBPERMISSIONS;
+	else if (type == "filecache")
+		scanType = BusClient::FILECACHE;
+	else if (type == "activities")
+		scanType = BusClient::ACTIVITIES;
+	else
+		return false;
+	return true;
 }
 
 static MojErr getTypes(MojObject typesArray, BusClient::ScanTypes &bitmask)
@@ -109,16 +142,72 @@ static MojErr getTypes(MojObject typesArray, BusClient::ScanTypes &bitmask)
 		err = element.stringValue(type);
 		MojErrCheck(err);
 
-		if (type == "dbkinds")
-			bitmask |= BusClient::DBKINDS;
-		else if (type == "dbpermissions")
-			bitmask |= BusClient::DBPERMISSIONS;
-		else if (type == "filecache")
-			bitmask |= BusClient::FILECACHE;
-		else if (type == "activities")
-			bitmask |= BusClient::ACTIVITIES;
-		else
+		BusClient::ScanType scanType;
+		if (!getType(type, scanType))
 			MojErrThrowMsg(MojErrInvalidMsg, "unrecognized type '%s'", type.data());
+		bitmask |= scanType;
+	}
+
+	return MojErrNone;
+}
+
+template <class Limiter>
+static MojErr getLimits(const MojObject& limitsObj, Limiter& limiter)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	if (limitsObj.type() != MojObject::TypeObject)
+		MojErrThrowMsg(MojErrInvalidMsg, "'limits' not an object");
+
+	for (MojObject::ConstIterator it = limitsObj.begin(); it != limitsObj.end(); ++it) {
+		MojInt64 limit = it.value().intValue();
+		if (limit < 0)
+			MojErrThrowMsg(MojErrInvalidMsg, "limit for '%s' can't be negative", it.key().data());
+		limiter.SetMaximum(it.key().data(), (size_t) limit);
+	}
+
+	return MojErrNone;
+}
+
+// the limits of a call, applied once all of it has been checked
+struct LimitUpdates {
+	typedef std::map<std::string, size_t> Maximums;
+	Maximums maximums;
+
+	void SetMaximum(const std::string& service, size_t maximum) { maximums[service] = maximum; }
+};
+
+// the options of a run call that end up shared by everything in the run
+static bool sameRunOptions(const MojObject& first, const MojObject& other)
+{
+	static const char* const options[] = { "window", "limits", "batch", "bootCache", "timeout", "retries" };
+
+	for (size_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+		MojObject firstValue, otherValue;
+		const bool inFirst = first.get(options[i], firstValue);
+		if (inFirst != other.get(options[i], otherValue) || (inFirst && firstValue != otherValue))
+			return false;
+	}
+	return true;
+}
+
+template <class Windows>
+static MojErr getWindows(const MojObject& windowObj, Windows &windows)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	if (windowObj.type() != MojObject::TypeObject)
+		MojErrThrowMsg(MojErrInvalidMsg, "'window' not an object");
+
+	for (MojObject::ConstIterator it = windowObj.begin(); it != windowObj.end(); ++it) {
+		BusClient::ScanType scanType;
+		if (!getType(it.key(), scanType))
+			MojErrThrowMsg(MojErrInvalidMsg, "unrecognized type '%s'", it.key().data());
+
+		MojInt64 window = it.value().intValue();
+		if (window < 1)
+			MojErrThrowMsg(MojErrInvalidMsg, "window for '%s' must be at least 1", it.key().data());
+		windows[scanType] = (size_t) window;
 	}
 
 	return MojErrNone;
@@ -136,14 +225,41 @@ This method will scan all folders and run all configuration files.
 Name | Required | Type | Description
 -----|----------|------|------------
 types | yes  | Array | List of different configuration types. Types are dbkinds, filecache, activities.
+window | no | Object | Maximum number of requests kept in flight per configuration type, e.g. {"dbkinds": 16}. Types without an entry use their built-in default.
+batch | no | Boolean | Put the permissions sharing an owner with a single putPermissions call. Defaults to false.
+limits | no | Object | Maximum number of configs in flight per target service, shared by all configurators, e.g. {"com.palm.db": 16}. The actual limit adapts to the reply latency and errors of the service below that. Kept until the configurator exits; 0 restores the default of 32.
+details | no | Boolean | Reply with the failed configurations (the first 16) and a failed count. Defaults to false.
+deadlineMs | no | Integer | Milliseconds the caller is willing to wait, from the time the call arrives. Once passed, the configurations not sent yet are dropped and the call is answered with what got done (returnValue false, errorCode for a timeout). A subscribed caller going away cancels the call the same way, without the reply. Defaults to 0, no deadline.
+timeout | no | Integer | Milliseconds to wait for the reply to a configuration before it is sent again (or counted as failed). Defaults to 5000, 0 waits forever. At most 600000.
+retries | no | Integer | Number of times a configuration that timed out or failed with a transient error is sent again, with a backoff doubling from 250 ms up to 4 s. Defaults to 2, at most 16.
+subscribe | no | Boolean | Stream the progress: an update as each configurator is done and the counters every second, ahead of the reply. Defaults to false.
+bootCache | no | Boolean | Skip the activities, temp db kinds and temp db permissions already configured during this boot. Their services lose them on a reboot, so they are only remembered until then - a service restarted meanwhile needs a run without it. Defaults to false.
+critical | no | Array | Configuration types to wait for, e.g. ["dbkinds", "dbpermissions"]. The reply is sent as soon as those are configured, the other types keep being configured in the background. Defaults to all the types.
 
 @par Returns(Call)
 Name | Required | Type | Description
 -----|----------|------|------------
 returnValue | yes | Boolean | True
+failed | no | Integer | Number of configurations that failed, when details is set
+failures | no | Array | Path, service, errorCode and errorText of the failed configurations, when details is set and some failed (returnValue is false then)
+truncated | no | Boolean | Whether there were more failures than reported, when details is set and some failed
+cancelled | no | Integer | Number of configurations dropped unsent, when the deadline passed
+background | no | Integer | Number of configurators still running, when replied to once the critical types are done (the counts are for those types then)
 
 @par Returns(Subscription)
-None
+Name | Required | Type | Description
+-----|----------|------|------------
+returnValue | yes | Boolean | True
+subscribed | yes | Boolean | True
+configured | yes | Integer | Number of configurations processed successfully so far
+sent | yes | Integer | Number of configurations sent to their service so far
+skipped | yes | Integer | Number of configurations skipped because they are already configured
+failed | yes | Integer | Number of configurations that failed so far
+remaining | yes | Integer | Number of configurators still working
+services | yes | Object | Per target service: sent, ok, failed and pending (found but without a result yet) configurations
+configurator | no | String | The configurator that is done, in the update sent for it
+service | no | String | Its target service, in the update sent for it
+directory | no | String | The directory it configured, in the update sent for it
 
 @}
 */
@@ -167,7 +283,57 @@ MojErr BusClient::BusMethods::Run(MojServiceMessage* msg, MojObject& payload)
 		err = getTypes(types, bitmask);
 		MojErrCheck(err);
 
-		m_client.m_msg.reset(msg);
+		InFlightWindows windows;
+		MojObject windowObj;
+		if (payload.get("window", windowObj)) {
+			err = getWindows(windowObj, windows);
+			MojErrCheck(err);
+		}
+
+		LimitUpdates limits;
+		MojObject limitsObj;
+		if (payload.get("limits", limitsObj)) {
+			err = getLimits(limitsObj, limits);
+			MojErrCheck(err);
+		}
+
+		bool batch = false;
+		payload.get("batch", batch);
+
+		bool bootCache = false;
+		payload.get("bootCache", bootCache);
+
+		MojObject criticalArray;
+		ScanTypes critical;
+		if (payload.get("critical", criticalArray)) {
+			err = getTypes(criticalArray, critical);
+			MojErrCheck(err);
+		}
+		MojInt64 timeout = Configurator::DEFAULT_TIMEOUT_MS;
+		payload.get("timeout", timeout);
+		if (timeout < 0)
+			MojErrThrowMsg(MojErrInvalidMsg, "'timeout' can't be negative");
+		if (timeout > Configurator::MAX_TIMEOUT_MS)
+			MojErrThrowMsg(MojErrInvalidMsg, "'timeout' can't be more than %u", Configurator::MAX_TIMEOUT_MS);
+
+		MojInt64 retries = Configurator::DEFAULT_RETRIES;
+		payload.get("retries", retries);
+		if (retries < 0)
+			MojErrThrowMsg(MojErrInvalidMsg, "'retries' can't be negative");
+		if (retries > Configurator::MAX_RETRIES)
+			MojErrThrowMsg(MojErrInvalidMsg, "'retries' can't be more than %u", Configurator::MAX_RETRIES);
+
+		// all of the call checked out - nothing was changed before this
+		ActiveRequest *request = m_client.CurrentRequest();
+		if (request)
+			request->critical = critical;
+		for (LimitUpdates::Maximums::const_iterator i = limits.maximums.begin(); i != limits.maximums.end(); ++i)
+			m_client.m_limiter.SetMaximum(i->first, i->second);
+		m_client.m_inFlightWindows = windows;
+		m_client.m_batchPermissions = batch;
+		m_client.m_bootCache = bootCache;
+		m_client.m_requestTimeout = (guint) timeout;
+		m_client.m_requestRetries = (unsigned) retries;
 		m_client.Run(bitmask);
 
 	} catch (const std::exception& e) {
@@ -183,7 +349,8 @@ bool BusClient::BusMethods::WorkEnqueued(Callback callback, MojServiceMessage *m
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
 
-	if (m_client.m_msg.get() == NULL)
+	// the scheduler is handing the request over
+	if (m_client.m_dispatching)
 		return false;
 
 	BusClient::PendingWork pending;
@@ -191,7 +358,12 @@ bool BusClient::BusMethods::WorkEnqueued(Callback callback, MojServiceMessage *m
 	pending.callback = callback;
 	pending.msg.reset(msg);
 	pending.payload = payload;
-	m_client.m_pending.push_back(pending);
+	m_client.WatchRequest(msg, payload);
+
+	// everything but run is about a single package
+	const Lane lane = callback == (Callback) &BusMethods::Run ? BulkLane : InteractiveLane;
+	m_client.m_lanes[lane].push_back(pending);
+	m_client.ScheduleDispatch();
 	return true;
 }
 
@@ -204,20 +376,50 @@ bool BusClient::BusMethods::WorkEnqueued(Callback callback, MojServiceMessage *m
 
 Force re-run all configurations.
 
+Takes an array of packages, or for a bulk scan an object with the packages - their
+configurations are then handled by one configurator per type and target service.
+
 @par Parameters
 Name | Required | Type | Description
 -----|----------|------|------------
 id | yes  | String | Application Id
 type | yes | String | Either 'app' or 'service'
 location | yes | String | Indicates if it is a system app or a third party app.
+smart | no | Boolean | Only re-run the configurations whose content changed since they were last configured. Defaults to false.
+packages | no | Array | Bulk scan: the packages, each with id, type, location and smart as above.
+subscribe | no | Boolean | Stream the progress: an update as each configurator (and each package of a bulk scan) is done and the counters every second, ahead of the reply. Defaults to false.
+details | no | Boolean | Reply with the failed configurations (the first 16) and a failed count. Defaults to false.
+deadlineMs | no | Integer | Milliseconds the caller is willing to wait, from the time the call arrives. Once passed, the configurations not sent yet are dropped and the call is answered with what got done (returnValue false, errorCode for a timeout). A subscribed caller going away cancels the call the same way, without the reply. Defaults to 0, no deadline.
 
 @par Returns(Call)
 Name | Required | Type | Description
 -----|----------|------|------------
 returnValue | yes | Boolean | True
+configured | yes | Integer | Number of configurations processed successfully
+sent | yes | Integer | Number of configurations sent to their service
+skipped | yes | Integer | Number of configurations skipped because they are already configured
+failed | no | Integer | Number of configurations that failed, when details is set
+failures | no | Array | Path, service, errorCode and errorText of the failed configurations, when details is set and some failed (returnValue is false then)
+truncated | no | Boolean | Whether there were more failures than reported, when details is set and some failed
+cancelled | no | Integer | Number of configurations dropped unsent, when the deadline passed
 
 @par Returns(Subscription)
-None
+Name | Required | Type | Description
+-----|----------|------|------------
+returnValue | yes | Boolean | True
+subscribed | yes | Boolean | True
+configured | yes | Integer | Number of configurations processed successfully so far (of the package, in its update)
+sent | yes | Integer | Number of configurations sent to their service so far
+skipped | yes | Integer | Number of configurations skipped because they are already configured
+failed | yes | Integer | Number of configurations that failed so far
+remaining | no | Integer | Number of configurators still working, except in the package updates
+services | no | Object | Per target service: sent, ok, failed and pending (found but without a result yet) configurations, except in the package updates
+configurator | no | String | The configurator that is done, in the update sent for it
+service | no | String | Its target service, in the update sent for it
+directory | no | String | The directory it configured, in the update sent for it
+id | no | String | The package that is done, in the update sent for each package of a bulk scan
+failures | no | Array | Path, service, errorCode and errorText of the failed configurations of the package, in its update when details is set
+truncated | no | Boolean | Whether the package had more failures than reported, in its update when details is set
 
 @}
 */
@@ -241,20 +443,49 @@ MojErr BusClient::BusMethods::Rescan(MojServiceMessage* msg, MojObject& payload)
 
 Run configuration in safe mode. It doesn't re-run any configurations that were run already.
 
+Takes an array of packages, or for a bulk scan an object with the packages - their
+configurations are then handled by one configurator per type and target service.
+
 @par Parameters
 Name | Required | Type | Description
 -----|----------|------|------------
 id | yes  | String | Application Id
 type | yes | String | Either 'app' or 'service'
 location | yes | String | Indicates if it is a system app or a third party app.
+packages | no | Array | Bulk scan: the packages, each with id, type and location as above.
+subscribe | no | Boolean | Stream the progress: an update as each configurator (and each package of a bulk scan) is done and the counters every second, ahead of the reply. Defaults to false.
+details | no | Boolean | Reply with the failed configurations (the first 16) and a failed count. Defaults to false.
+deadlineMs | no | Integer | Milliseconds the caller is willing to wait, from the time the call arrives. Once passed, the configurations not sent yet are dropped and the call is answered with what got done (returnValue false, errorCode for a timeout). A subscribed caller going away cancels the call the same way, without the reply. Defaults to 0, no deadline.
 
 @par Returns(Call)
 Name | Required | Type | Description
 -----|----------|------|------------
 returnValue | yes | Boolean | True
+configured | yes | Integer | Number of configurations processed successfully
+sent | yes | Integer | Number of configurations sent to their service
+skipped | yes | Integer | Number of configurations skipped because they are already configured
+failed | no | Integer | Number of configurations that failed, when details is set
+failures | no | Array | Path, service, errorCode and errorText of the failed configurations, when details is set and some failed (returnValue is false then)
+truncated | no | Boolean | Whether there were more failures than reported, when details is set and some failed
+cancelled | no | Integer | Number of configurations dropped unsent, when the deadline passed
 
 @par Returns(Subscription)
-None
+Name | Required | Type | Description
+-----|----------|------|------------
+returnValue | yes | Boolean | True
+subscribed | yes | Boolean | True
+configured | yes | Integer | Number of configurations processed successfully so far (of the package, in its update)
+sent | yes | Integer | Number of configurations sent to their service so far
+skipped | yes | Integer | Number of configurations skipped because they are already configured
+failed | yes | Integer | Number of configurations that failed so far
+remaining | no | Integer | Number of configurators still working, except in the package updates
+services | no | Object | Per target service: sent, ok, failed and pending (found but without a result yet) configurations, except in the package updates
+configurator | no | String | The configurator that is done, in the update sent for it
+service | no | String | Its target service, in the update sent for it
+directory | no | String | The directory it configured, in the update sent for it
+id | no | String | The package that is done, in the update sent for each package of a bulk scan
+failures | no | Array | Path, service, errorCode and errorText of the failed configurations of the package, in its update when details is set
+truncated | no | Boolean | Whether the package had more failures than reported, in its update when details is set
 
 @}
 */
@@ -278,48 +509,32 @@ MojErr BusClient::BusMethods::ScanRequest(MojServiceMessage* msg, MojObject& pay
 
 	try {
 		MojErr err;
-		if (payload.type() != MojObject::TypeArray) {
+		MojObject packages;
+		const bool bulk = payload.type() == MojObject::TypeObject && payload.get("packages", packages);
+		if (bulk) {
+			if (packages.type() != MojObject::TypeArray)
+				MojErrThrowMsg(MojErrInvalidMsg, "'packages' not an array");
+		} else if (payload.type() != MojObject::TypeArray) {
 			MojErrThrowMsg(MojErrInternal, "invalid message format");
+		} else {
+			packages = payload;
 		}
 
-		m_client.m_msg.reset(msg);
-
-		for (MojObject::ConstArrayIterator it = payload.arrayBegin(); it != payload.arrayEnd(); it++) {
-			const MojObject& request = *it;
-			MojString locationStr;
-			MojString typeStr;
-			MojString app;
-			BusClient::PackageType type;
-			BusClient::PackageLocation location;
-
-			err = request.getRequired("id", app);
-			MojErrCheck(err);
-
-			err = request.getRequired("type", typeStr);
+		BusClient::Packages bulkPackages;
+		for (MojObject::ConstArrayIterator it = packages.arrayBegin(); it != packages.arrayEnd(); it++) {
+			BusClient::Package package;
+			err = ParsePackage(*it, confmode, package);
 			MojErrCheck(err);
 
-			err = request.getRequired("location", locationStr);
-			MojErrCheck(err);
-
-			if (typeStr == "app") {
-				type = BusClient::Application;
-			} else if (typeStr == "service") {
-				type = BusClient::Service;
-			} else {
-				MojErrThrow(MojErrInvalidMsg);
-			}
-
-			if (locationStr == "system") {
-				location = BusClient::System;
-			} else if (locationStr == "third party") {
-				location = BusClient::ThirdParty;
-			} else {
-				MojErrThrow(MojErrInvalidMsg);
-			}
-
-			m_client.Scan(confmode, app, type, location);
+			if (bulk)
+				bulkPackages.push_back(package);
+			else
+				m_client.Scan(package.mode, package.id, package.type, package.location);
 		}
 
+		if (bulk)
+			m_client.ScanPackages(bulkPackages);
+
 	} catch (const std::exception& e) {
 		MojErrThrowMsg(MojErrInternal, "%s", e.what());
 	} catch (...) {
@@ -329,6 +544,44 @@ MojErr BusClient::BusMethods::ScanRequest(MojServiceMessage* msg, MojObject& pay
 	return MojErrNone;
 }
 
+MojErr BusClient::BusMethods::ParsePackage(const MojObject& request, ConfigurationMode confmode, Package& package)
+{
+	MojString locationStr;
+	MojString typeStr;
+
+	MojErr err = request.getRequired("id", package.id);
+	MojErrCheck(err);
+
+	err = request.getRequired("type", typeStr);
+	MojErrCheck(err);
+
+	err = request.getRequired("location", locationStr);
+	MojErrCheck(err);
+
+	if (typeStr == "app") {
+		package.type = BusClient::Application;
+	} else if (typeStr == "service") {
+		package.type = BusClient::Service;
+	} else {
+		MojErrThrow(MojErrInvalidMsg);
+	}
+
+	if (locationStr == "system") {
+		package.location = BusClient::System;
+	} else if (locationStr == "third party") {
+		package.location = BusClient::ThirdParty;
+	} else {
+		MojErrThrow(MojErrInvalidMsg);
+	}
+
+	bool smart = false;
+	package.mode = confmode;
+	if (confmode == BusClient::ForceRescan && request.get("smart", smart) && smart)
+		package.mode = BusClient::SmartRescan;
+
+	return MojErrNone;
+}
+
 //->Start of API documentation comment block
 /**
 @page com_palm_configurator com.palm.configurator
@@ -343,11 +596,17 @@ Name | Required | Type | Description
 id | yes  | String | Application or Service Id
 type | yes | String | Either 'app' or 'service'
 location | yes | String | Indicates if it is a system or a third party app.
+details | no | Boolean | Reply with the failed configurations (the first 16) and a failed count. Defaults to false.
+deadlineMs | no | Integer | Milliseconds the caller is willing to wait, from the time the call arrives. Once passed, the configurations not sent yet are dropped and the call is answered with what got done (returnValue false, errorCode for a timeout). A subscribed caller going away cancels the call the same way, without the reply. Defaults to 0, no deadline.
 
 @par Returns(Call)
 Name | Required | Type | Description
 -----|----------|------|------------
 returnValue | yes | Boolean | True
+failed | no | Integer | Number of configurations that failed, when details is set
+failures | no | Array | Path, service, errorCode and errorText of the failed configurations, when details is set and some failed (returnValue is false then)
+truncated | no | Boolean | Whether there were more failures than reported, when details is set and some failed
+cancelled | no | Integer | Number of configurations dropped unsent, when the deadline passed
 
 @par Returns(Subscription)
 None
@@ -371,8 +630,6 @@ MojErr BusClient::BusMethods::Unconfigure(MojServiceMessage *msg, MojObject &pay
 			MojErrThrowMsg(MojErrInternal, "invalid message format");
 		}
 
-		m_client.m_msg.reset(msg);
-
 		for (MojObject::ConstArrayIterator it = payload.arrayBegin(); it != payload.arrayEnd(); it++) {
 			const MojObject& request = *it;
 			MojString locationStr;
@@ -427,20 +684,115 @@ MojErr BusClient::BusMethods::Unconfigure(MojServiceMessage *msg, MojObject &pay
 	return MojErrNone;
 }
 
+//->Start of API documentation comment block
+/**
+@page com_palm_configurator com.palm.configurator
+@{
+@section com_palm_configurator_getstats getStats
+
+Report how long the configurations took since the service started, per configurator and target service.
+Durations are in microseconds; percentiles are the upper bound of the power-of-two bucket they fall in.
+
+@par Parameters
+Name | Required | Type | Description
+-----|----------|------|------------
+reset | no | Boolean | Clear the statistics after reporting them. Defaults to false.
+
+@par Returns(Call)
+Name | Required | Type | Description
+-----|----------|------|------------
+returnValue | yes | Boolean | True
+runs | yes | Object | Duration of whole requests: count, totalUs, p50Us, p95Us, maxUs
+configurators | yes | Array | Per configurator: configurator, service, ok, failed, skipped, sent and the durations of each phase (scan, read, parse, process, roundTrip) in the same format as runs
+services | yes | Object | Per target service: the current concurrency limit, its maximum, the configs in flight, fastestUs, backoffs and failures
+
+@par Returns(Subscription)
+None
+
+@}
+*/
+//->End of API documentation comment block
+
+MojErr BusClient::BusMethods::GetStats(MojServiceMessage* msg, MojObject& payload)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	// answered right away, even while a request is running
+	MojObject response;
+	MojErr err = m_client.m_stats.ToJson(response);
+	MojErrCheck(err);
+
+	MojObject services;
+	err = m_client.m_limiter.ToJson(services);
+	MojErrCheck(err);
+	err = response.put("services", services);
+	MojErrCheck(err);
+
+	bool reset = false;
+	payload.get("reset", reset);
+	if (reset)
+		m_client.m_stats.Reset();
+
+	err = msg->replySuccess(response);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
 BusClient::BusClient()
 : m_dbClient(&m_service),
   m_mediaDbClient(&m_service, MojDbServiceDefs::MediaServiceName),
   m_tempDbClient(&m_service, MojDbServiceDefs::TempServiceName),
   m_configuratorsCompleted(0),
+  m_readyCursor(0),
+  m_runSource(0),
+  m_runRequested(false),
+  m_deadlineSource(0),
   m_launchedAsService(false),
   m_shuttingDown(false),
-  m_wrongAplication(false),
-  m_timerTimeout(0)
+  m_progressSource(0),
+  m_countersSource(0),
+  m_busy(false),
+  m_dispatching(false),
+  m_dispatchScheduled(false),
+  m_runLane(BulkLane),
+  m_currentLane(BulkLane),
+  m_joinedRun(false),
+  m_joinedCallback(NULL),
+  m_timerTimeout(0),
+  m_stampIndex(kConfCacheDir),
+  m_bootStamps(kConfCacheDir, ".boot-stamp-index", StampIndex::BootId()),
+  m_bootCache(false),
+  m_firstUseIndex(kConfCacheDir),
+  m_scanPool(NULL),
+  m_bundle(kConfCacheDir),
+  m_batchPermissions(false),
+  m_requestTimeout(Configurator::DEFAULT_TIMEOUT_MS),
+  m_requestRetries(Configurator::DEFAULT_RETRIES),
+  m_runStarted(false),
+  m_resident(false),
+  m_idleTtl(0),
+  m_trimSource(0),
+  m_trimLevel(0),
+  m_idle(false),
+  m_lastIdleUs(0),
+  m_watcher(*this)
 {
+	GError *error = NULL;
+	m_scanPool = g_thread_pool_new(&BusClient::ScanWorker, this, SCAN_WORKERS, FALSE, &error);
+	if (m_scanPool == NULL) {
+		LOG_WARNING(MSGID_BUS_CLIENT_ERROR, 1,
+				PMLOGKS("error", error ? error->message : ""),
+				"Failed to create scan workers, scanning on the main loop instead");
+		if (error)
+			g_error_free(error);
+	}
 }
 
 BusClient::~BusClient()
 {
+	if (m_scanPool)
+		g_thread_pool_free(m_scanPool, FALSE, TRUE);
 }
 
 MojDbClient& BusClient::GetDbClient()
@@ -448,6 +800,44 @@ MojDbClient& BusClient::GetDbClient()
 	return m_dbClient;
 }
 
+StampIndex& BusClient::GetStampIndex()
+{
+	return m_stampIndex;
+}
+
+StampIndex* BusClient::GetBootStampIndex()
+{
+	// without a boot id the stamps would never be dropped
+	if (m_bootStamps.Session().empty())
+		return NULL;
+	return &m_bootStamps;
+}
+
+FirstUseIndex& BusClient::GetFirstUseIndex()
+{
+	return m_firstUseIndex;
+}
+
+ConfiguratorStats& BusClient::GetStats()
+{
+	return m_stats;
+}
+
+DependencyTracker& BusClient::GetDependencies()
+{
+	return m_dependencies;
+}
+
+PathTable& BusClient::GetPaths()
+{
+	return m_paths;
+}
+
+ServiceLimiter& BusClient::GetLimiter()
+{
+	return m_limiter;
+}
+
 MojRefCountedPtr<MojServiceRequest> BusClient::CreateRequest()
 {
 	MojRefCountedPtr<MojServiceRequest> req;
@@ -477,10 +867,19 @@ MojErr BusClient::open()
 	err = m_service.attach(m_reactor.impl());
 	MojErrCheck(err);
 
+	m_stampIndex.Load();
+	m_bootStamps.Load();
+	m_firstUseIndex.Load();
+
+	// before anything runs so no change is missed
+	if (m_resident)
+		StartWatching();
+
 	// If we're not launched as a service, then we're launching at boot,
 	// which means we should run all the configurators.
 	if (!m_launchedAsService) {
 		LOG_DEBUG("Not run as dynamic service - run startup configurations");
+		m_busy = true;
 		Run(DBKINDS | DBPERMISSIONS | FILECACHE | ACTIVITIES);
 		RunNextConfigurator();
 	} else {
@@ -501,12 +900,23 @@ MojErr BusClient::handleArgs(const StringVec& args)
 	MojErr err = Base::handleArgs(args);
 	MojErrCheck(err);
 
-	if (args.size() && args[0] == "service")
-		m_launchedAsService = true;
+	for (StringVec::const_iterator i = args.begin(); i != args.end(); ++i) {
+		if (*i == "service")
+			m_launchedAsService = true;
+		else if (*i == "resident")
+			m_resident = true;
+		else if (startsWith(i->data(), "idle="))
+			m_idleTtl = strtoul(i->data() + strlen("idle="), NULL, 10);
+	}
 
 	return MojErrNone;
 }
 
+std::string BusClient::RootDir(const char* dir) const
+{
+	return m_root + dir;
+}
+
 std::string BusClient::appConfDir(const MojString& appId, PackageType type, PackageLocation location)
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
@@ -514,10 +924,10 @@ std::string BusClient::appConfDir(const MojString& appId, PackageType type, Pack
 
 	switch (location) {
 	case System:
-		confPath = "/";
+		confPath = RootDir(BASE_ROOT);
 		break;
 	case ThirdParty:
-		confPath = BASE_CRYPTOFS;
+		confPath = RootDir(BASE_CRYPTOFS);
 		break;
 	}
 
@@ -533,7 +943,9 @@ std::string BusClient::appConfDir(const MojString& appId, PackageType type, Pack
 	}
 	confPath.append(appId.begin(), appId.end());
 	if (access(confPath.c_str(), R_OK) != 0) {
-		m_wrongAplication = true;
+		ActiveRequest *request = CurrentRequest();
+		if (request)
+			request->wrongApplication = true;
 	}
 
 	return confPath + CONF_SUBDIR;
@@ -542,144 +954,540 @@ std::string BusClient::appConfDir(const MojString& appId, PackageType type, Pack
 void BusClient::Run(ScanTypes bitmask)
 {
 	MojString id;
-	ScanDir(id, Configurator::Configure, ROOT_BASE_DIR, bitmask, Configurator::ConfigUnknown, DeprecatedDbKind);
+	ScanDir(id, Configurator::Configure, RootDir(ROOT_BASE_DIR), bitmask, Configurator::ConfigUnknown, DeprecatedDbKind);
+}
+
+void BusClient::WantedDirs(ScanTypes bitmask, AdditionalFileTypes types, std::vector<const char*>& wanted)
+{
+	// the kinds ahead of their permissions
+	wanted.reserve(CONFIG_DIR_COUNT);
+	if (bitmask & DBKINDS) {
+		if (types & DeprecatedDbKind)
+			wanted.push_back(OLD_DB_KIND_DIR);
+		wanted.push_back(DB_KIND_DIR);
+		wanted.push_back(MEDIADB_KIND_DIR);
+		wanted.push_back(TEMPDB_KIND_DIR);
+	}
+	if (bitmask & DBPERMISSIONS) {
+		wanted.push_back(DB_PERMISSIONS_DIR);
+		wanted.push_back(MEDIADB_PERMISSIONS_DIR);
+		wanted.push_back(TEMPDB_PERMISSIONS_DIR);
+	}
+	if (bitmask & FILECACHE)
+		wanted.push_back(FILE_CACHE_CONFIG_DIR);
+	if (bitmask & ACTIVITIES)
+		wanted.push_back(ACTIVITY_CONFIG_DIR);
+}
+
+void BusClient::BeginRun()
+{
+	if (!m_runStarted) {
+		m_runTimer = ConfiguratorStats::Timer();
+		m_runStarted = true;
+	}
+
+	AbortShutdown();
 }
 
 void BusClient::ScanDir(const MojString& _id, Configurator::RunType scanType, const std::string &baseDir, ScanTypes bitmask, Configurator::ConfigType configType, AdditionalFileTypes types)
 {
 	const std::string id(_id.data(), _id.length());
+	const size_t firstConfigurator = m_configurators.size();
 
-	if (m_shuttingDown) {
-		LOG_DEBUG("Aborting shutdown - request received");
-		assert(m_timerTimeout != 0);
-		g_source_remove(m_timerTimeout);
-		m_timerTimeout = 0;
-		assert(m_shuttingDown);
-		m_shuttingDown = false;
-	}
+	BeginRun();
 
-	if (bitmask & DBKINDS) {
-		if (types & DeprecatedDbKind) {
+	std::vector<const char*> wanted;
+	WantedDirs(bitmask, types, wanted);
+
+	// most packages only have one or two of them - nothing is set up for
+	// the ones that don't exist
+	const unsigned found = wanted.empty() ? 0 : DirScanner::FindSubdirs(baseDir, &wanted[0], wanted.size());
+	for (size_t i = 0; i < wanted.size(); i++) {
+		if (!(found & (1u << i)))
+			continue;
+
+		if (wanted[i] == OLD_DB_KIND_DIR) {
 			// deprecated
 			LOG_WARNING(MSGID_BUS_CLIENT_ERROR, 1,
 					PMLOGKS("directory", baseDir.c_str()),
 					"Scanning deprecated mojodb config directory under %s", baseDir.c_str());
-			ConfiguratorPtr oldDbKindConfigurator(new DbKindConfigurator(id, configType, scanType, *this, m_dbClient, baseDir + OLD_DB_KIND_DIR));
-			m_configurators.push_back(oldDbKindConfigurator);
 		}
+		AddConfiguratorFor(wanted[i], id, scanType, baseDir, configType);
+	}
 
-		ConfiguratorPtr dbKindConfigurator(new DbKindConfigurator(id, configType, scanType, *this, m_dbClient, baseDir + DB_KIND_DIR));
-		m_configurators.push_back(dbKindConfigurator);
+	// the system directories are read-only image content - on boot they can
+	// come from the pre-parsed bundle
+	const bool useBundle = baseDir == RootDir(ROOT_BASE_DIR) && scanType == Configurator::Configure;
+	if (m_dispatching) {
+		ScanGroup group;
+		group.firstConfigurator = firstConfigurator;
+		group.useBundle = useBundle;
+		m_deferredScans.push_back(group);
+	} else {
+		StartScans(firstConfigurator, useBundle);
+	}
+}
 
-        ConfiguratorPtr mediaDbKindConfigurator(new MediaDbKindConfigurator(id, configType, scanType, *this, m_mediaDbClient, baseDir + MEDIADB_KIND_DIR));
-        m_configurators.push_back(mediaDbKindConfigurator);
+void BusClient::AddConfiguratorFor(const char* subdir, const std::string& id, Configurator::RunType runType, const std::string& baseDir, Configurator::ConfigType configType)
+{
+	const std::string directory = baseDir + subdir;
+
+	if (subdir == OLD_DB_KIND_DIR || subdir == DB_KIND_DIR) {
+		AddDbKindConfigurator(new DbKindConfigurator(id, configType, runType, *this, m_dbClient, directory), runType);
+	} else if (subdir == MEDIADB_KIND_DIR) {
+		AddDbKindConfigurator(new MediaDbKindConfigurator(id, configType, runType, *this, m_mediaDbClient, directory), runType);
+	} else if (subdir == TEMPDB_KIND_DIR) {
+		AddDbKindConfigurator(new TempDbKindConfigurator(id, configType, runType, *this, m_tempDbClient, directory), runType);
+	} else if (subdir == DB_PERMISSIONS_DIR) {
+		AddDbPermissionsConfigurator(new DbPermissionsConfigurator(id, configType, runType, *this, m_dbClient, directory), runType);
+	} else if (subdir == MEDIADB_PERMISSIONS_DIR) {
+		AddDbPermissionsConfigurator(new MediaDbPermissionsConfigurator(id, configType, runType, *this, m_mediaDbClient, directory), runType);
+	} else if (subdir == TEMPDB_PERMISSIONS_DIR) {
+		AddDbPermissionsConfigurator(new TempDbPermissionsConfigurator(id, configType, runType, *this, m_tempDbClient, directory), runType);
+	} else if (subdir == FILE_CACHE_CONFIG_DIR) {
+		ConfiguratorPtr fileCacheConfigurator(new FileCacheConfigurator(id, configType, runType, *this, directory));
+		AddConfigurator(fileCacheConfigurator, FILECACHE, runType);
+	} else if (subdir == ACTIVITY_CONFIG_DIR) {
+		ConfiguratorPtr activityConfigurator(new ActivityConfigurator(id, configType, runType, *this, directory));
+		AddConfigurator(activityConfigurator, ACTIVITIES, runType);
+	} else {
+		assert(false);
+	}
+}
 
-		ConfiguratorPtr tempDbKindConfigurator(new TempDbKindConfigurator(id, configType, scanType, *this, m_tempDbClient, baseDir + TEMPDB_KIND_DIR));
-		m_configurators.push_back(tempDbKindConfigurator);
+void BusClient::StartScans(size_t firstConfigurator, bool useBundle)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
 
+	if (useBundle)
+		m_bundle.Load();
+
+	std::vector<ScanTarget> targets;
+	for (size_t i = firstConfigurator; i < m_configurators.size(); i++) {
+		if (useBundle && m_bundle.Apply(*m_configurators[i]))
+			continue;
+
+		for (size_t directory = 0; directory < m_configurators[i]->DirectoryCount(); directory++) {
+			targets.push_back(ScanTarget());
+			ScanTarget& target = targets.back();
+			target.configurator = m_configurators[i];
+			target.index = directory;
+			target.directory = target.configurator->ConfigDirectory(directory);
+			target.folderFound = false;
+			target.scanTime = 0;
+			target.configurator->BeginScan();
+		}
 	}
 
-	if (bitmask & DBPERMISSIONS) {
-		ConfiguratorPtr dbPermsConfigurator(new DbPermissionsConfigurator(id, configType, scanType, *this, m_dbClient, baseDir + DB_PERMISSIONS_DIR));
-		m_configurators.push_back(dbPermsConfigurator);
-
-        ConfiguratorPtr mediaDbPermsConfigurator(new MediaDbPermissionsConfigurator(id, configType, scanType, *this, m_mediaDbClient, baseDir + MEDIADB_PERMISSIONS_DIR));
-        m_configurators.push_back(mediaDbPermsConfigurator);
+	if (targets.empty())
+		return;
 
-		ConfiguratorPtr tempDbPermsConfigurator(new TempDbPermissionsConfigurator(id, configType, scanType, *this, m_tempDbClient, baseDir + TEMPDB_PERMISSIONS_DIR));
-		m_configurators.push_back(tempDbPermsConfigurator);
+	// spread over the workers so the directories are walked side by side,
+	// still with one hand-off per worker rather than one per directory
+	const size_t jobCount = m_scanPool ? std::min(targets.size(), (size_t) SCAN_WORKERS) : 1;
+	std::vector<ScanJob*> jobs;
+	for (size_t i = 0; i < jobCount; i++) {
+		jobs.push_back(new ScanJob);
+		jobs.back()->client = this;
+		jobs.back()->updateBundle = useBundle;
 	}
-
-	if (bitmask & FILECACHE) {
-		ConfiguratorPtr fileCacheConfigurator(new FileCacheConfigurator(id, configType, scanType, *this, baseDir + FILE_CACHE_CONFIG_DIR));
-		m_configurators.push_back(fileCacheConfigurator);
+	for (size_t i = 0; i < targets.size(); i++) {
+		std::vector<ScanTarget>& jobTargets = jobs[i % jobCount]->targets;
+		jobTargets.push_back(ScanTarget());
+		std::swap(jobTargets.back(), targets[i]);
 	}
 
-	if (bitmask & ACTIVITIES) {
-		ActivityConfigurator *activityConfigurator = new ActivityConfigurator(id, configType, scanType, *this, baseDir + ACTIVITY_CONFIG_DIR);
-		m_configurators.push_back(activityConfigurator);
+	for (std::vector<ScanJob*>::const_iterator job = jobs.begin(); job != jobs.end(); ++job) {
+		if (m_scanPool) {
+			GError *error = NULL;
+			if (g_thread_pool_push(m_scanPool, *job, &error))
+				continue;
+
+			LOG_WARNING(MSGID_BUS_CLIENT_ERROR, 2,
+					PMLOGKS("directory", (*job)->targets[0].directory.c_str()),
+					PMLOGKS("error", error ? error->message : ""),
+					"Failed to queue scan of %s", (*job)->targets[0].directory.c_str());
+			if (error)
+				g_error_free(error);
+		}
+
+		// no workers - scan right here
+		ScanWorker(*job, NULL);
 	}
 }
 
-void BusClient::Scan(ConfigurationMode confmode, const MojString &appId, PackageType type, PackageLocation location)
+void BusClient::ScanWorker(gpointer data, gpointer)
 {
-	LOG_TRACE("Entering function %s", __FUNCTION__);
-
-	LOG_DEBUG("Scanning %s %d@%d", appId.data(), type, location);
-	std::string confPath = appConfDir(appId, type, location);
-	Configurator::RunType mode = Configurator::Configure;
-	switch (confmode) {
-	case ForceRescan:
-		mode = Configurator::Reconfigure;
-		break;
-	case LazyScan:
-		mode = Configurator::Configure;
-		break;
+	ScanJob *job = static_cast<ScanJob*>(data);
+	for (std::vector<ScanTarget>::iterator i = job->targets.begin(); i != job->targets.end(); ++i) {
+		ConfiguratorStats::Timer scanTimer;
+		i->folderFound = DirScanner::Scan(i->directory, i->entries, job->updateBundle ? &i->directories : NULL);
+		i->scanTime = scanTimer.Elapsed();
 	}
 
-	ScanDir(appId, mode, confPath, DBKINDS | DBPERMISSIONS | FILECACHE | ACTIVITIES, PackageTypeToConfigType(type));
-
-	LOG_DEBUG("Scan of %s finished", appId.data());
+	// hand the results back to the main loop
+	g_idle_add(&BusClient::ScanCompleteCallback, job);
 }
 
-void BusClient::Unconfigure(const MojString &appId, PackageType type, PackageLocation location, ScanTypes bitmask)
+gboolean BusClient::ScanCompleteCallback(gpointer data)
 {
-	std::string confPath = appConfDir(appId, type, location);
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+	ScanJob *job = static_cast<ScanJob*>(data);
+
+	for (std::vector<ScanTarget>::iterator i = job->targets.begin(); i != job->targets.end(); ++i) {
+		job->client->m_stats.Record(i->configurator->ConfiguratorName(), i->configurator->ServiceName(), ConfiguratorStats::Scan, i->scanTime);
+		i->configurator->ScanComplete(i->folderFound, i->entries, i->index);
+
+		if (job->updateBundle) {
+			// regenerated once the run is over to keep it off the boot path
+			BundleSections& updates = job->client->m_bundleUpdates;
+			updates.push_back(ConfigBundle::Section());
+			ConfigBundle::Section& section = updates.back();
+			section.directory = i->directory;
+			section.service = i->configurator->ServiceName();
+			section.folderFound = i->folderFound;
+			section.directories.swap(i->directories);
+			section.entries.swap(i->entries);
+		}
+	}
 
-	ScanDir(appId, Configurator::RemoveConfiguration, confPath, bitmask, PackageTypeToConfigType(type));
-	LOG_DEBUG("Removal of %s finished", appId.data());
+	job->client->RunNextConfigurator();
+	delete job;
+	return false;
 }
 
-void BusClient::RunNextConfigurator()
+void BusClient::UpdateBundle()
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
 
-	// Schedule an event to run the next configurator once the stack is unwound.
-	g_idle_add(&BusClient::IterateConfiguratorsCallback, this);
+	if (!m_bundleUpdates.empty()) {
+		m_bundle.Load();
+		for (BundleSections::const_iterator i = m_bundleUpdates.begin(); i != m_bundleUpdates.end(); ++i)
+			m_bundle.Update(*i);
+		m_bundleUpdates.clear();
+		m_bundle.Save();
+	}
+
+	// kept parsed for the next call unless exiting anyway
+	if (!m_resident && m_idleTtl == 0)
+		m_bundle.Clear();
 }
 
-gboolean BusClient::IterateConfiguratorsCallback(gpointer data)
+bool BusClient::AddConfigurator(const ConfiguratorPtr& configurator, ScanType type, Configurator::RunType runType)
 {
-	LOG_TRACE("Entering function %s", __FUNCTION__);
-	BusClient* client = static_cast<BusClient*>(data);
-
-	if (client->m_configuratorsCompleted == client->m_configurators.size()) {
-		if (!client->m_shuttingDown) {
-			LOG_DEBUG("No more configurators left (%d configurations completed, %d configurations failed), shutting down.", Configurator::ConfigureOk().size(), Configurator::ConfigureFailure().size());
-			client->ScheduleShutdown();
-			return client->m_msg.get() != NULL;
+	ActiveRequest *request = CurrentRequest();
+
+	// requests run together may want the same directory configured the same
+	// way - one configurator serves all of them
+	const std::string key = IndexKey(configurator->ConfigDirectory(), runType, m_bootCache);
+	ConfiguratorIndex::const_iterator existing = m_configuratorIndex.find(key);
+	if (existing != m_configuratorIndex.end() && m_configurators[existing->second].get()) {
+		LOG_DEBUG("%s :: %s already part of this run", configurator->ConfiguratorName(), configurator->ConfigDirectory().c_str());
+		if (request) {
+			m_configurators[existing->second]->AddTally(&request->tally);
+			if (request->critical & type)
+				m_configurators[existing->second]->AddTally(&request->criticalTally);
 		}
 		return false;
 	}
 
-	gboolean configurationsRemaining = FALSE;
-	// iterate through 1 file in each configurator
-	for (int i = 0, ni = client->m_configurators.size(); i < ni; i++) {
-		bool exceptionThrown = true;
-		try {
-				ConfiguratorPtr configurator = client->m_configurators[i];
-				if (configurator.get() == NULL)
-					continue;
+	InFlightWindows::const_iterator window = m_inFlightWindows.find(type);
+	if (window != m_inFlightWindows.end())
+		configurator->SetInFlightWindow(window->second);
+	if (request) {
+		configurator->AddTally(&request->tally);
+		if (request->critical & type)
+			configurator->AddTally(&request->criticalTally);
+	}
+	configurator->SetRetryPolicy(m_requestTimeout, m_requestRetries);
+	configurator->SetBootCache(m_bootCache);
+
+	// a service that never replies must not hold up the run
+	if (m_deadlineSource == 0)
+		m_deadlineSource = g_timeout_add(DEADLINE_CHECK_MS, &BusClient::DeadlineCallback, this);
+
+	m_configuratorIndex[key] = m_configurators.size();
+	configurator->SetSlot(m_configurators.size());
+	m_ready.push_back(m_configurators.size());
+	m_configurators.push_back(configurator);
+	m_configuratorLanes.push_back(m_currentLane);
+	return true;
+}
 
-				if (!configurator->Run())
-					configurationsRemaining = TRUE;
-				exceptionThrown = false;
-		} catch (const std::exception& e) {
-			LOG_CRITICAL(MSGID_BUS_CLIENT_ERROR, 1,
-					PMLOGKS("exception", e.what()),
+void BusClient::AddDbKindConfigurator(DbKindConfigurator *configurator, Configurator::RunType runType)
+{
+	ConfiguratorPtr ptr(configurator);
+
+	// the permissions of its kinds wait for it
+	if (AddConfigurator(ptr, DBKINDS, runType) && runType != Configurator::RemoveConfiguration)
+		m_dependencies.AddProvider(ptr.get(), ptr->ServiceName());
+}
+
+void BusClient::AddDbPermissionsConfigurator(DbPermissionsConfigurator *configurator, Configurator::RunType runType)
+{
+	ConfiguratorPtr ptr(configurator);
+	configurator->SetBatchOperations(m_batchPermissions);
+	AddConfigurator(ptr, DBPERMISSIONS, runType);
+}
+
+void BusClient::Scan(ConfigurationMode confmode, const MojString &appId, PackageType type, PackageLocation location)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	LOG_DEBUG("Scanning %s %d@%d", appId.data(), type, location);
+	std::string confPath = appConfDir(appId, type, location);
+
+	ScanDir(appId, RunTypeFor(confmode), confPath, DBKINDS | DBPERMISSIONS | FILECACHE | ACTIVITIES, PackageTypeToConfigType(type));
+
+	LOG_DEBUG("Scan of %s finished", appId.data());
+}
+
+void BusClient::ScanPackages(const Packages& packages)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	ActiveRequest *request = CurrentRequest();
+	const size_t firstConfigurator = m_configurators.size();
+
+	BeginRun();
+
+	std::vector<const char*> wanted;
+	WantedDirs(DBKINDS | DBPERMISSIONS | FILECACHE | ACTIVITIES, None, wanted);
+
+	for (Packages::const_iterator i = packages.begin(); i != packages.end(); ++i) {
+		const std::string id(i->id.data(), i->id.length());
+		const std::string confPath = appConfDir(i->id, i->type, i->location);
+		const Configurator::RunType runType = RunTypeFor(i->mode);
+		const Configurator::ConfigType configType = PackageTypeToConfigType(i->type);
+
+		ConfigTally *tally = NULL;
+		if (request) {
+			request->packages.push_back(PackageProgress());
+			request->packages.back().id = id;
+			request->packages.back().reported = false;
+			tally = &request->packages.back().tally;
+		}
+
+		const unsigned found = DirScanner::FindSubdirs(confPath, &wanted[0], wanted.size());
+		for (size_t dir = 0; dir < wanted.size(); dir++) {
+			if (!(found & (1u << dir)))
+				continue;
+
+			// the directories of every package configured the same way go
+			// to the same configurator - files carry the id they belong to
+			std::string key = wanted[dir];
+			key += ':';
+			key += (char) ('0' + configType);
+			key += (char) ('0' + runType);
+			key += m_bootCache ? 'b' : '-';
+
+			ConfiguratorIndex::const_iterator shared = m_bulkIndex.find(key);
+			if (shared != m_bulkIndex.end() && m_configurators[shared->second].get()) {
+				const ConfiguratorPtr& configurator = m_configurators[shared->second];
+				const std::string directory = confPath + wanted[dir];
+				configurator->AddDirectory(directory, id, tally);
+				m_configuratorIndex[IndexKey(directory, runType, m_bootCache)] = shared->second;
+				continue;
+			}
+
+			const size_t added = m_configurators.size();
+			AddConfiguratorFor(wanted[dir], id, runType, confPath, configType);
+			if (m_configurators.size() == added) {
+				// already part of the run for another request
+				continue;
+			}
+			m_bulkIndex[key] = added;
+			m_configurators[added]->SetDirectoryTally(0, tally);
+		}
+	}
+	LOG_DEBUG("Bulk scan of %zu packages with %zu configurators", packages.size(), m_configurators.size() - firstConfigurator);
+
+	if (m_dispatching) {
+		ScanGroup group;
+		group.firstConfigurator = firstConfigurator;
+		group.useBundle = false;
+		m_deferredScans.push_back(group);
+	} else {
+		m_bulkIndex.clear();
+		StartScans(firstConfigurator, false);
+	}
+}
+
+Configurator::RunType BusClient::RunTypeFor(ConfigurationMode confmode)
+{
+	switch (confmode) {
+	case ForceRescan:
+		return Configurator::Reconfigure;
+	case SmartRescan:
+		return Configurator::SmartReconfigure;
+	case LazyScan:
+	default:
+		return Configurator::Configure;
+	}
+}
+
+std::string BusClient::IndexKey(const std::string& directory, Configurator::RunType runType, bool bootCache)
+{
+	std::string key = directory;
+	key += ':';
+	key += (char) ('0' + runType);
+	// a configurator trusting the per-boot stamps can't serve a run that doesn't
+	key += bootCache ? 'b' : '-';
+	return key;
+}
+
+void BusClient::Unconfigure(const MojString &appId, PackageType type, PackageLocation location, ScanTypes bitmask)
+{
+	std::string confPath = appConfDir(appId, type, location);
+
+	ScanDir(appId, Configurator::RemoveConfiguration, confPath, bitmask, PackageTypeToConfigType(type));
+	LOG_DEBUG("Removal of %s finished", appId.data());
+}
+
+void BusClient::RunNextConfigurator()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	// Run the configurators once the stack is unwound - a single source
+	// serves every request made meanwhile
+	m_runRequested = true;
+	if (m_runSource == 0)
+		m_runSource = g_idle_add(&BusClient::IterateConfiguratorsCallback, this);
+}
+
+gboolean BusClient::IterateConfiguratorsCallback(gpointer data)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+	BusClient* client = static_cast<BusClient*>(data);
+	return client->RunConfigurators();
+}
+
+gboolean BusClient::DeadlineCallback(gpointer data)
+{
+	BusClient* client = static_cast<BusClient*>(data);
+	return client->CheckDeadlines();
+}
+
+bool BusClient::CheckDeadlines()
+{
+	if (m_configuratorsCompleted == m_configurators.size()) {
+		m_deadlineSource = 0;
+		return false;
+	}
+
+	// configurators completing meanwhile don't change the ready list
+	for (size_t i = 0; i < m_ready.size(); i++) {
+		ConfiguratorPtr configurator = m_configurators[m_ready[i]];
+		if (configurator.get() == NULL)
+			continue;
+
+		try {
+			configurator->CheckDeadlines();
+		} catch (const std::exception& e) {
+			LOG_CRITICAL(MSGID_BUS_CLIENT_ERROR, 1,
+					PMLOGKS("exception", e.what()),
+					"exception while checking configurator deadlines: %s", e.what());
+		} catch (...) {
+			LOG_CRITICAL(MSGID_BUS_CLIENT_ERROR, 0, "uncaught exception while checking configurator deadlines");
+		}
+	}
+	return true;
+}
+
+bool BusClient::RunConfigurators()
+{
+	if (m_configuratorsCompleted == m_configurators.size()) {
+		// anything scheduled from here on needs a new source
+		m_runSource = 0;
+		m_runRequested = false;
+		m_readyCursor = 0;
+		if (!m_shuttingDown) {
+			LOG_DEBUG("No more configurators left (%zu configurators completed), shutting down.", m_configuratorsCompleted);
+			ScheduleShutdown();
+		}
+		return false;
+	}
+
+	if (m_readyCursor == 0) {
+		// a new pass covers everything asked for so far
+		m_runRequested = false;
+		CompactReady();
+	}
+
+	// give each configurator the chance to fill its in-flight window, but
+	// hand the main loop back once the slice is used up
+	const ConfiguratorStats::Timer slice;
+	while (m_readyCursor < m_ready.size()) {
+		const size_t slot = m_ready[m_readyCursor++];
+		bool exceptionThrown = true;
+		try {
+				ConfiguratorPtr configurator = m_configurators[slot];
+				if (configurator.get() == NULL)
+					continue;
+
+				configurator->Run();
+				exceptionThrown = false;
+		} catch (const std::exception& e) {
+			LOG_CRITICAL(MSGID_BUS_CLIENT_ERROR, 1,
+					PMLOGKS("exception", e.what()),
 					"exception while running configurator: %s", e.what());
 		} catch (...) {
 			LOG_CRITICAL(MSGID_BUS_CLIENT_ERROR, 0, "uncaught exception while running configurator");
 		}
 
 		// If an exception was thrown, remove it from the queue and keep going
-		if (exceptionThrown) {
-			client->ConfiguratorComplete(i);
+		if (exceptionThrown && m_configurators[slot].get())
+			ConfiguratorComplete(slot);
+
+		if (slice.Elapsed() >= RUN_SLICE_US)
+			break;
+	}
+
+	// the rest of the pass goes on with the next wakeup
+	if (m_readyCursor < m_ready.size())
+		return true;
+	m_readyCursor = 0;
+
+	// replies and completions during the pass ask for another one
+	if (m_runRequested)
+		return true;
+
+	m_runSource = 0;
+	return false;
+}
+
+void BusClient::CompactReady()
+{
+	// the configurators of interactive calls go first
+	std::vector<size_t> ready;
+	ready.reserve(m_ready.size());
+	for (int lane = InteractiveLane; lane < LaneCount; lane++) {
+		for (size_t i = 0; i < m_ready.size(); i++) {
+			const size_t slot = m_ready[i];
+			if (m_configurators[slot].get() && m_configuratorLanes[slot] == lane)
+				ready.push_back(slot);
 		}
 	}
+	m_ready.swap(ready);
+}
 
-	// return whether or not there are more configurations remaining
-	return configurationsRemaining;
+void BusClient::ClearConfigurators()
+{
+	m_configuratorsCompleted = 0;
+	m_configurators.clear();
+	m_configuratorIndex.clear();
+	m_bulkIndex.clear();
+	m_ready.clear();
+	m_readyCursor = 0;
+	m_configuratorLanes.clear();
+	m_dependencies.Clear();
+	Configurator::ResetConfigStats();
+
+	// a reply still outstanding from an earlier run looks its path up (and
+	// so does its configurator) - the table is only cleared once none is
+	// left, as interning the same paths again reuses their entries anyway
+	if (ConfiguratorCallback::LiveCount() == 0)
+		m_paths.Clear();
 }
 
 void BusClient::ConfiguratorComplete(ConfiguratorCollection::iterator configurator)
@@ -687,21 +1495,23 @@ void BusClient::ConfiguratorComplete(ConfiguratorCollection::iterator configurat
 	LOG_TRACE("Entering function %s", __FUNCTION__);
 
 	LOG_DEBUG("... configurator %s complete (%p), %zd left.", (*configurator)->ConfiguratorName(), configurator->get(), m_configurators.size() - 1);
+	m_dependencies.Finished(configurator->get());
+	ReportCompletion(**configurator);
+	(*configurator)->ReleaseTallies();
 	configurator->reset();
 	m_configuratorsCompleted++;
+
+	// requests served by the configurators done so far
+	if (!m_dispatching)
+		ReplyToFinished();
 	RunNextConfigurator();
 }
 
 void BusClient::ConfiguratorComplete(Configurator* configurator)
 {
-	ConfiguratorCollection::iterator i, ni;
-	for (i = m_configurators.begin(), ni = m_configurators.end(); i != ni; i++) {
-		ConfiguratorPtr ptr(*i);
-		if (ptr.get() && &(*ptr) == configurator) {
-			ConfiguratorComplete(i);
-			return;
-		}
-	}
+	const size_t slot = configurator->Slot();
+	if (slot < m_configurators.size() && m_configurators[slot].get() == configurator)
+		ConfiguratorComplete(m_configurators.begin() + slot);
 }
 
 void BusClient::ConfiguratorComplete(int configuratorIndex)
@@ -710,56 +1520,209 @@ void BusClient::ConfiguratorComplete(int configuratorIndex)
 	ConfiguratorComplete(i);
 }
 
-void BusClient::ScheduleShutdown()
+void BusClient::AbortShutdown()
+{
+	if (m_idle) {
+		m_lastIdleUs = m_idleTimer.Elapsed();
+		m_idle = false;
+		if (m_trimSource) {
+			g_source_remove(m_trimSource);
+			m_trimSource = 0;
+		}
+		LOG_DEBUG("Back from %lld ms idle (trim level %u)", (long long) (m_lastIdleUs / 1000), m_trimLevel);
+	}
+
+	if (m_shuttingDown) {
+		LOG_DEBUG("Aborting shutdown - request received");
+		assert(m_timerTimeout != 0);
+		g_source_remove(m_timerTimeout);
+		m_timerTimeout = 0;
+		assert(m_shuttingDown);
+		m_shuttingDown = false;
+	}
+}
+
+void BusClient::StartWatching()
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
-	// Reply to the "run" message now that we're done
-	if (m_launchedAsService && m_msg.get()) {
-		const Configurator::ConfigCollection& ok = Configurator::ConfigureOk();
-		const Configurator::ConfigCollection& failed = Configurator::ConfigureFailure();
-
-		if (m_wrongAplication) {
-			MojString response;
-			response.appendFormat("Application or service doesn't exist");
-			m_wrongAplication = false;
-            if(m_msg->replyError(MojErrInternal, response.data()) != MojErrNone) {
-                LOG_WARNING(MSGID_SHUTDOWN_ERROR, 1, PMLOGKS("Response", response.data()), "Application or service doesn't exist");
-            }
-		} else if (!failed.empty()) {
-			MojString response;
-			response.appendFormat("Partial configuration - %zu ok, %zu failed", ok.size(), failed.size());
-            if(m_msg->replyError(MojErrInternal, response.data()) != MojErrNone) {
-                LOG_WARNING(MSGID_SHUTDOWN_ERROR, 1, PMLOGKS("Response", response.data()), "Partial configuration");
-            }
-		} else {
-			MojObject response;
-			response.putInt("configured", ok.size());
-            if(m_msg->replySuccess(response) != MojErrNone) {
-                LOG_WARNING(MSGID_SHUTDOWN_ERROR, 0, "Configured");
-            }
+
+	if (!m_watcher.Start())
+		return;
+
+	for (size_t i = 0; i < CONFIG_DIR_COUNT; i++)
+		m_watcher.WatchTree(RootDir(ROOT_BASE_DIR) + CONFIG_DIRS[i], RootDir(ROOT_BASE_DIR), "", Configurator::ConfigUnknown);
+
+	const char* const locations[] = { BASE_ROOT, BASE_CRYPTOFS };
+	for (size_t i = 0; i < sizeof(locations) / sizeof(locations[0]); i++) {
+		const std::string packages = RootDir(locations[i]) + BASE_PALM_OFFSET;
+
+		// without the trailing '/'
+		std::string apps = packages + APPS_DIR;
+		apps.erase(apps.length() - 1);
+		m_watcher.WatchPackages(apps, CONF_SUBDIR, Configurator::ConfigApplication);
+
+		std::string services = packages + SERVICES_DIR;
+		services.erase(services.length() - 1);
+		m_watcher.WatchPackages(services, CONF_SUBDIR, Configurator::ConfigService);
+	}
+	LOG_DEBUG("Staying resident, watching the configuration directories");
+}
+
+void BusClient::ConfigsChanged(const ConfigWatcher::Changes& changes)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	m_changes.insert(m_changes.end(), changes.begin(), changes.end());
+
+	// otherwise picked up once the current run is over
+	if (!m_busy)
+		RunChanges();
+}
+
+void BusClient::RunChanges()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	struct ChangedDirectory {
+		const char* subdir;
+		const ConfigWatcher::Change* change;
+		DirScanner::Entries entries;
+	};
+	typedef std::map<std::string, ChangedDirectory> ChangedDirectories;
+
+	ChangedDirectories directories;
+	for (ConfigWatcher::Changes::const_iterator i = m_changes.begin(); i != m_changes.end(); ++i) {
+		if (i->removed) {
+			// nothing left to read the configuration from - removing it is
+			// still up to unconfigure, the file gets configured again if it
+			// comes back
+			m_stampIndex.Unmark(i->path);
+			m_bootStamps.Unmark(i->path);
+			continue;
+		}
+
+		for (size_t dir = 0; dir < CONFIG_DIR_COUNT; dir++) {
+			const std::string directory = i->baseDir + CONFIG_DIRS[dir];
+			if (i->path.compare(0, directory.length(), directory) != 0 || i->path[directory.length()] != '/')
+				continue;
+
+			ChangedDirectory& changed = directories[directory];
+			changed.subdir = CONFIG_DIRS[dir];
+			changed.change = &*i;
+
+			// relative to the configuration directory, like DirScanner reports it
+			DirScanner::Entry entry;
+			entry.path = i->path;
+			size_t last = i->path.rfind('/');
+			if (last > directory.length()) {
+				size_t previous = i->path.rfind('/', last - 1);
+				entry.parent = i->path.substr(previous + 1, last - previous - 1);
+			}
+			changed.entries.push_back(entry);
+			break;
 		}
-		m_msg.reset();
 	}
 
-	if (!m_pending.empty()) {
-		LOG_DEBUG("%d pending service calls to handle remaining", m_pending.size());
+	if (directories.empty()) {
+		m_changes.clear();
+		m_stampIndex.Save();
+		m_bootStamps.Save();
+		m_firstUseIndex.Save();
+		return;
+	}
+
+	AbortShutdown();
+	ClearConfigurators();
+	m_busy = true;
+	m_runLane = BulkLane;
+	m_joinedRun = false;
+	m_runTimer = ConfiguratorStats::Timer();
+	m_runStarted = true;
+
+	for (ChangedDirectories::const_iterator i = directories.begin(); i != directories.end(); ++i) {
+		const ConfigWatcher::Change& change = *i->second.change;
+		const size_t added = m_configurators.size();
+		AddConfiguratorFor(i->second.subdir, change.id, Configurator::Configure, change.baseDir, change.configType);
+		if (m_configurators.size() == added)
+			continue;
+
+		// the watcher already knows which files to look at
+		LOG_DEBUG("%zu changed configurations in %s", i->second.entries.size(), i->first.c_str());
+		m_configurators.back()->ScanComplete(true, i->second.entries);
+	}
+	m_changes.clear();
+
+	RunNextConfigurator();
+}
+
+void BusClient::ScheduleShutdown()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	// resident - nothing ran since the last time
+	if (m_resident && !m_busy)
+		return;
+
+	if (m_runStarted) {
+		m_stats.RecordRun(m_runTimer.Elapsed());
+		m_runStarted = false;
+	}
+
+	// Reply to the requests now that we're done
+	ReplyToRequests();
+	RunFinished();
+	m_inFlightWindows.clear();
+	m_batchPermissions = false;
+	m_bootCache = false;
+	m_requestTimeout = Configurator::DEFAULT_TIMEOUT_MS;
+	m_requestRetries = Configurator::DEFAULT_RETRIES;
+	m_busy = false;
+
+	if (HasPending()) {
+		LOG_DEBUG("%zu pending service calls to handle remaining", m_lanes[InteractiveLane].size() + m_lanes[BulkLane].size());
 
 		// still more pending work
-		m_configuratorsCompleted = 0;
-		m_configurators.clear();
-		Configurator::ResetConfigStats();
+		DispatchPending();
+		return;
+	}
 
-		const PendingWork &pending = m_pending.back();
-		(pending.instance->*(pending.callback))(pending.msg.get(), pending.payload);
+	if (!m_changes.empty()) {
+		RunChanges();
+		return;
+	}
+
+	m_stampIndex.Save();
+	m_bootStamps.Save();
+	m_firstUseIndex.Save();
+	UpdateBundle();
+	m_stats.LogSummary();
+
+	if (m_resident || m_idleTtl) {
+		// callers coming back at a steady pace should find everything
+		// still warm - wait for longer than they stayed away last time
+		gint64 delayMs = std::max<gint64>(IDLE_TRIM_MIN_MS, 2 * m_lastIdleUs / 1000);
+		if (m_idleTtl)
+			delayMs = std::min<gint64>(delayMs, (gint64) m_idleTtl * 1000 / 2);
+		m_idle = true;
+		m_idleTimer = ConfiguratorStats::Timer();
+		m_trimLevel = 0;
+		ScheduleTrim(delayMs);
+	}
 
-		m_pending.pop_back();
+	if (m_resident) {
+		LOG_DEBUG("No more pending service calls to handle - waiting for changes");
 		return;
 	}
 
 	LOG_DEBUG("No more pending service calls to handle - scheduling shutdown");
 
 	// Schedule an event to shutdown once the stack is unwound.
-	if (m_timerTimeout == 0) {
+	if (m_timerTimeout == 0 && m_idleTtl) {
+		// the next call comes to this process instead of paying for a new
+		// one - also long enough for the race described below
+		LOG_DEBUG("Staying around for %u s", m_idleTtl);
+		m_timerTimeout = g_timeout_add_seconds_full(G_PRIORITY_DEFAULT_IDLE, m_idleTtl, &BusClient::ShutdownCallback, this, NULL);
+	} else if (m_timerTimeout == 0) {
 		// this is to work around around a race condition where the LSCall is delivered
 		// after we shutdown causing us to start back up - give some time for the LSCall
 		// to get delivered.  NOV-114626.  This needs a proper fix within ls2 (can't be
@@ -776,6 +1739,604 @@ void BusClient::ScheduleShutdown()
 	m_shuttingDown = true;
 }
 
+void BusClient::ScheduleTrim(guint delayMs)
+{
+	if (m_trimSource)
+		g_source_remove(m_trimSource);
+	m_trimSource = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, delayMs, &BusClient::TrimCallback, this, NULL);
+}
+
+void BusClient::TrimIdle()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	// the cheapest to rebuild goes first - the stamps & the db clients
+	// stay for as long as the process does
+	switch (m_trimLevel) {
+	case 0:
+		// late replies still find the last run as they left it - the next
+		// run clears it anyway
+		if (ConfiguratorCallback::LiveCount() > 0) {
+			LOG_DEBUG("Idle - %zu replies still outstanding, keeping the last run", ConfiguratorCallback::LiveCount());
+		} else {
+			LOG_DEBUG("Idle - dropping the configurators of the last run");
+			ClearConfigurators();
+		}
+		ConfiguratorCallback::TrimPool();
+		break;
+	case 1:
+		LOG_DEBUG("Still idle - dropping the parsed configuration bundle");
+		m_bundle.Clear();
+		break;
+	default:
+		return;
+	}
+	m_trimLevel++;
+	malloc_trim(0);
+
+	// the next step once it stayed idle twice as long
+	ScheduleTrim(std::max<gint64>(IDLE_TRIM_MIN_MS, m_idleTimer.Elapsed() / 1000));
+}
+
+void BusClient::RunFinished()
+{
+}
+
+BusClient::RequestWatch::RequestWatch(BusClient& client, MojServiceMessage* msg, guint deadlineMs)
+	: m_cancelSlot(this, &RequestWatch::HandleCancel),
+	  m_client(client),
+	  m_msg(msg),
+	  m_deadlineSource(0)
+{
+	msg->addCancelHandler(m_cancelSlot);
+	if (deadlineMs > 0)
+		m_deadlineSource = g_timeout_add(deadlineMs, &RequestWatch::ExpiredCallback, this);
+}
+
+BusClient::RequestWatch::~RequestWatch()
+{
+	Stop();
+}
+
+void BusClient::RequestWatch::Stop()
+{
+	m_cancelSlot.cancel();
+	if (m_deadlineSource) {
+		g_source_remove(m_deadlineSource);
+		m_deadlineSource = 0;
+	}
+}
+
+MojErr BusClient::RequestWatch::HandleCancel(MojServiceMessage* msg)
+{
+	// dropped from the watches meanwhile
+	MojRefCountedPtr<RequestWatch> self(this);
+
+	LOG_DEBUG("Caller of %p went away", m_msg);
+	m_client.CancelRequest(m_msg, false);
+	return MojErrNone;
+}
+
+gboolean BusClient::RequestWatch::ExpiredCallback(gpointer data)
+{
+	MojRefCountedPtr<RequestWatch> self(static_cast<RequestWatch*>(data));
+	self->m_deadlineSource = 0;
+
+	LOG_DEBUG("Deadline of %p passed", self->m_msg);
+	self->m_client.CancelRequest(self->m_msg, true);
+	return false;
+}
+
+void BusClient::WatchRequest(MojServiceMessage* msg, const MojObject& payload)
+{
+	MojInt64 deadline = 0;
+	payload.get("deadlineMs", deadline);
+	if (deadline < 0)
+		deadline = 0;
+
+	MojRefCountedPtr<RequestWatch> watch(new RequestWatch(*this, msg, (guint) deadline));
+	m_watches[msg] = watch;
+}
+
+void BusClient::UnwatchRequest(MojServiceMessage* msg)
+{
+	RequestWatches::iterator i = m_watches.find(msg);
+	if (i == m_watches.end())
+		return;
+
+	i->second->Stop();
+	m_watches.erase(i);
+}
+
+void BusClient::CancelRequest(MojServiceMessage* msg, bool expired)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	// still queued - it is never started (and holds up nothing behind it)
+	for (int lane = InteractiveLane; lane < LaneCount; lane++) {
+		for (PendingWorkCollection::iterator i = m_lanes[lane].begin(); i != m_lanes[lane].end(); ++i) {
+			if (i->msg.get() != msg)
+				continue;
+
+			LOG_DEBUG("Dropping queued service call (%s)", expired ? "deadline passed" : "caller gone");
+			if (expired && msg->replyError(MojErrTimedOut, "Deadline passed before the call was started") != MojErrNone)
+				LOG_WARNING(MSGID_SHUTDOWN_ERROR, 0, "Deadline passed");
+			UnwatchRequest(msg);
+			m_lanes[lane].erase(i);
+			return;
+		}
+	}
+
+	for (ActiveRequests::iterator request = m_active.begin(); request != m_active.end(); ++request) {
+		if (request->msg.get() != msg || request->cancelled)
+			continue;
+		request->cancelled = true;
+
+		// the configurators nobody else waits for stop sending - the
+		// requests replied to early still want theirs to go on
+		size_t stopped = 0;
+		for (ConfiguratorCollection::iterator i = m_configurators.begin(); i != m_configurators.end(); ++i) {
+			if (i->get() == NULL || !(*i)->Serves(&request->tally))
+				continue;
+
+			bool wanted = false;
+			for (ActiveRequests::const_iterator other = m_active.begin(); other != m_active.end() && !wanted; ++other)
+				wanted = &*other != &*request && !other->cancelled && (*i)->Serves(&other->tally);
+			if (!wanted) {
+				(*i)->Cancel();
+				stopped++;
+			}
+		}
+		LOG_DEBUG("Cancelled service call (%s), %zu configurators stopped", expired ? "deadline passed" : "caller gone", stopped);
+
+		if (expired) {
+			Reply(*request);
+		} else {
+			UnwatchRequest(msg);
+			request->msg.reset();
+		}
+		RunNextConfigurator();
+		return;
+	}
+}
+
+void BusClient::ReplyToRequests()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	for (ActiveRequests::iterator i = m_active.begin(); i != m_active.end(); ++i)
+		Reply(*i);
+	m_active.clear();
+}
+
+void BusClient::ReplyToFinished()
+{
+	for (ActiveRequests::iterator i = m_active.begin(); i != m_active.end(); ++i) {
+		if (i->tally.pending == 0 || (i->critical && i->criticalTally.pending == 0))
+			Reply(*i);
+	}
+}
+
+void BusClient::PackageFinished()
+{
+	// reported together once the stack is unwound
+	if (m_progressSource == 0)
+		m_progressSource = g_idle_add(&BusClient::ProgressCallback, this);
+}
+
+gboolean BusClient::ProgressCallback(gpointer data)
+{
+	BusClient* client = static_cast<BusClient*>(data);
+	client->m_progressSource = 0;
+	client->ReportProgress();
+	return false;
+}
+
+void BusClient::ReportProgress()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	for (ActiveRequests::iterator i = m_active.begin(); i != m_active.end(); ++i) {
+		if (!i->subscribed || i->msg.get() == NULL)
+			continue;
+
+		for (std::deque<PackageProgress>::iterator package = i->packages.begin(); package != i->packages.end(); ++package) {
+			if (package->reported || package->tally.pending > 0)
+				continue;
+			package->reported = true;
+
+			MojObject response;
+			MojErr err;
+			if (i->details) {
+				err = ResultToJson(package->tally, response);
+			} else {
+				err = response.putInt("configured", package->tally.ok);
+				if (err == MojErrNone)
+					err = response.putInt("sent", package->tally.sent);
+				if (err == MojErrNone)
+					err = response.putInt("skipped", package->tally.skipped);
+				if (err == MojErrNone)
+					err = response.putInt("failed", package->tally.failed);
+			}
+			if (err == MojErrNone)
+				err = response.putString("id", package->id.c_str());
+			if (err == MojErrNone)
+				err = response.putBool("subscribed", true);
+			if (err == MojErrNone)
+				err = i->msg->replySuccess(response);
+			if (err != MojErrNone) {
+				LOG_WARNING(MSGID_BUS_CLIENT_ERROR, 1, PMLOGKS("package", package->id.c_str()), "Failed to report the progress of %s", package->id.c_str());
+			}
+		}
+	}
+}
+
+gboolean BusClient::CountersCallback(gpointer data)
+{
+	BusClient* client = static_cast<BusClient*>(data);
+	if (client->ReportCounters())
+		return true;
+
+	client->m_countersSource = 0;
+	return false;
+}
+
+void BusClient::StartCounters()
+{
+	if (m_countersSource == 0)
+		m_countersSource = g_timeout_add(COUNTERS_INTERVAL_MS, &BusClient::CountersCallback, this);
+}
+
+bool BusClient::ReportCounters()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	bool subscribers = false;
+	for (ActiveRequests::iterator i = m_active.begin(); i != m_active.end(); ++i) {
+		if (!i->subscribed || i->msg.get() == NULL)
+			continue;
+		subscribers = true;
+
+		MojObject response;
+		MojErr err = ProgressToJson(i->tally, response);
+		if (err == MojErrNone)
+			err = i->msg->replySuccess(response);
+		if (err != MojErrNone) {
+			LOG_WARNING(MSGID_BUS_CLIENT_ERROR, 0, "Failed to report the progress counters");
+		}
+	}
+	return subscribers;
+}
+
+void BusClient::ReportCompletion(const Configurator& configurator)
+{
+	for (ActiveRequests::iterator i = m_active.begin(); i != m_active.end(); ++i) {
+		if (!i->subscribed || i->msg.get() == NULL || !configurator.Serves(&i->tally))
+			continue;
+
+		MojObject response;
+		MojErr err = ProgressToJson(i->tally, response);
+		// the tallies are released right after this
+		if (err == MojErrNone)
+			err = response.putInt("remaining", i->tally.pending - 1);
+		if (err == MojErrNone)
+			err = response.putString("configurator", configurator.ConfiguratorName());
+		if (err == MojErrNone)
+			err = response.putString("service", configurator.ServiceName());
+		if (err == MojErrNone)
+			err = response.putString("directory", configurator.ConfigDirectory().c_str());
+		if (err == MojErrNone)
+			err = i->msg->replySuccess(response);
+		if (err != MojErrNone) {
+			LOG_WARNING(MSGID_BUS_CLIENT_ERROR, 1, PMLOGKS("configurator", configurator.ConfiguratorName()), "Failed to report %s as done", configurator.ConfiguratorName());
+		}
+	}
+}
+
+MojErr BusClient::ProgressToJson(const ConfigTally& tally, MojObject& progress) const
+{
+	MojErr err;
+	err = progress.putBool("subscribed", true);
+	MojErrCheck(err);
+	err = progress.putInt("configured", tally.ok);
+	MojErrCheck(err);
+	err = progress.putInt("sent", tally.sent);
+	MojErrCheck(err);
+	err = progress.putInt("skipped", tally.skipped);
+	MojErrCheck(err);
+	err = progress.putInt("failed", tally.failed);
+	MojErrCheck(err);
+	err = progress.putInt("remaining", tally.pending);
+	MojErrCheck(err);
+
+	MojObject services;
+	for (ConfigTally::ServiceCountMap::const_iterator i = tally.services.begin(); i != tally.services.end(); ++i) {
+		const size_t done = i->second.ok + i->second.failed;
+
+		MojObject counts;
+		err = counts.putInt("sent", i->second.sent);
+		MojErrCheck(err);
+		err = counts.putInt("ok", i->second.ok);
+		MojErrCheck(err);
+		err = counts.putInt("failed", i->second.failed);
+		MojErrCheck(err);
+		err = counts.putInt("pending", i->second.queued > done ? i->second.queued - done : 0);
+		MojErrCheck(err);
+		err = services.put(i->first.c_str(), counts);
+		MojErrCheck(err);
+	}
+	err = progress.put("services", services);
+	MojErrCheck(err);
+	return MojErrNone;
+}
+
+void BusClient::Reply(ActiveRequest& request)
+{
+	// already answered (early, or because it couldn't be started)
+	if (request.msg.get() == NULL)
+		return;
+
+	// the packages done since the last report go ahead of the result
+	if (request.subscribed && !request.packages.empty())
+		ReportProgress();
+
+	// done with the critical types - the reply is about those
+	const bool early = request.critical && request.tally.pending > 0;
+	const ConfigTally& tally = early ? request.criticalTally : request.tally;
+	if (early) {
+		LOG_DEBUG("Critical configurations done, %zu configurators go on in the background", request.tally.pending);
+	}
+
+	if (request.wrongApplication) {
+		MojString response;
+		response.appendFormat("Application or service doesn't exist");
+		if (request.msg->replyError(MojErrInternal, response.data()) != MojErrNone) {
+			LOG_WARNING(MSGID_SHUTDOWN_ERROR, 1, PMLOGKS("Response", response.data()), "Application or service doesn't exist");
+		}
+	} else if (request.cancelled) {
+		// what got done until the deadline
+		MojObject response;
+		MojErr err = MojErrNone;
+		if (request.details) {
+			err = ResultToJson(tally, response);
+		} else {
+			response.putInt("configured", tally.ok);
+			response.putInt("sent", tally.sent);
+			response.putInt("skipped", tally.skipped);
+			response.putInt("failed", tally.failed);
+		}
+		if (err == MojErrNone) {
+			MojString errorText;
+			errorText.appendFormat("Deadline passed - %zu ok, %zu failed, %zu sent, %zu skipped, %zu cancelled",
+					tally.ok, tally.failed, tally.sent, tally.skipped, tally.cancelled);
+			response.putInt("cancelled", tally.cancelled);
+			response.putBool("returnValue", false);
+			response.putInt("errorCode", MojErrTimedOut);
+			response.putString("errorText", errorText);
+			err = request.msg->reply(response);
+		}
+		if (err != MojErrNone) {
+			LOG_WARNING(MSGID_SHUTDOWN_ERROR, 0, "Deadline passed");
+		}
+	} else if (tally.failed > 0 && request.details) {
+		// the same error, with the failures attached
+		MojObject response;
+		MojErr err = ResultToJson(tally, response);
+		if (err == MojErrNone) {
+			MojString errorText;
+			errorText.appendFormat("Partial configuration - %zu ok, %zu failed, %zu sent, %zu skipped",
+					tally.ok, tally.failed, tally.sent, tally.skipped);
+			response.putBool("returnValue", false);
+			response.putInt("errorCode", MojErrInternal);
+			response.putString("errorText", errorText);
+			err = request.msg->reply(response);
+		}
+		if (err != MojErrNone) {
+			LOG_WARNING(MSGID_SHUTDOWN_ERROR, 0, "Partial configuration");
+		}
+	} else if (tally.failed > 0) {
+		MojString response;
+		response.appendFormat("Partial configuration - %zu ok, %zu failed, %zu sent, %zu skipped",
+				tally.ok, tally.failed, tally.sent, tally.skipped);
+		if (request.msg->replyError(MojErrInternal, response.data()) != MojErrNone) {
+			LOG_WARNING(MSGID_SHUTDOWN_ERROR, 1, PMLOGKS("Response", response.data()), "Partial configuration");
+		}
+	} else {
+		MojObject response;
+		response.putInt("configured", tally.ok);
+		response.putInt("sent", tally.sent);
+		response.putInt("skipped", tally.skipped);
+		if (request.details)
+			response.putInt("failed", tally.failed);
+		if (early)
+			response.putInt("background", request.tally.pending);
+		if (request.msg->replySuccess(response) != MojErrNone) {
+			LOG_WARNING(MSGID_SHUTDOWN_ERROR, 0, "Configured");
+		}
+	}
+	UnwatchRequest(request.msg.get());
+	request.msg.reset();
+}
+
+MojErr BusClient::ResultToJson(const ConfigTally& tally, MojObject& result) const
+{
+	MojErr err;
+	err = result.putInt("configured", tally.ok);
+	MojErrCheck(err);
+	err = result.putInt("sent", tally.sent);
+	MojErrCheck(err);
+	err = result.putInt("skipped", tally.skipped);
+	MojErrCheck(err);
+	err = result.putInt("failed", tally.failed);
+	MojErrCheck(err);
+
+	MojObject failures(MojObject::TypeArray);
+	for (ConfigTally::Failures::const_iterator i = tally.failures.begin(); i != tally.failures.end(); ++i) {
+		MojString errorText;
+		MojErrToString(i->err, errorText);
+
+		MojObject failure;
+		err = failure.putString("path", m_paths.Get(i->path).c_str());
+		MojErrCheck(err);
+		err = failure.putString("service", i->service);
+		MojErrCheck(err);
+		err = failure.putInt("errorCode", i->err);
+		MojErrCheck(err);
+		err = failure.putString("errorText", errorText);
+		MojErrCheck(err);
+		err = failures.push(failure);
+		MojErrCheck(err);
+	}
+	err = result.put("failures", failures);
+	MojErrCheck(err);
+
+	// only the first ones are kept
+	err = result.putBool("truncated", tally.failed > tally.failures.size());
+	MojErrCheck(err);
+	return MojErrNone;
+}
+
+BusClient::ActiveRequest* BusClient::CurrentRequest()
+{
+	// only while a request is being handed its configurators
+	if (!m_dispatching || m_active.empty())
+		return NULL;
+	return &m_active.back();
+}
+
+void BusClient::ScheduleDispatch()
+{
+	if (m_dispatchScheduled)
+		return;
+
+	// only interactive calls can join a run in progress
+	if (m_busy && (m_runLane != BulkLane || m_lanes[InteractiveLane].empty()))
+		return;
+
+	// let the calls that arrive in the same burst queue up so they can be run together
+	m_dispatchScheduled = true;
+	g_idle_add(&BusClient::DispatchCallback, this);
+}
+
+gboolean BusClient::DispatchCallback(gpointer data)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+	BusClient* client = static_cast<BusClient*>(data);
+	client->m_dispatchScheduled = false;
+	client->DispatchPending();
+	return false;
+}
+
+bool BusClient::HasPending() const
+{
+	return !m_lanes[InteractiveLane].empty() || !m_lanes[BulkLane].empty();
+}
+
+void BusClient::DispatchPending()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	if (m_dispatching)
+		return;
+
+	const PendingWorkCollection& interactive = m_lanes[InteractiveLane];
+	if (m_busy) {
+		// a call for a single package doesn't wait for a bulk run to finish -
+		// its configurators join the run and it is answered as soon as they
+		// are done.  Only calls of one kind join a run, so a scan and an
+		// unconfigure of the same package still happen in order.
+		if (m_runLane != BulkLane || interactive.empty())
+			return;
+		if (m_joinedRun && interactive.front().callback != m_joinedCallback)
+			return;
+
+		m_joinedRun = true;
+		m_joinedCallback = interactive.front().callback;
+		DispatchLane(InteractiveLane);
+		return;
+	}
+
+	const Lane lane = interactive.empty() ? BulkLane : InteractiveLane;
+	if (m_lanes[lane].empty())
+		return;
+
+	ClearConfigurators();
+	m_busy = true;
+	m_runLane = lane;
+	m_joinedRun = false;
+	DispatchLane(lane);
+}
+
+void BusClient::DispatchLane(Lane lane)
+{
+	PendingWorkCollection& pendingWork = m_lanes[lane];
+
+	// oldest first, together with the calls of the same kind (and with the
+	// same run options, those apply to the whole run) queued right behind
+	// it - anything else waits for the next run so nothing is overtaken
+	const PendingWork first = pendingWork.front();
+	size_t coalesced = 0;
+
+	m_dispatching = true;
+	m_currentLane = lane;
+	while (!pendingWork.empty() && pendingWork.front().instance == first.instance && pendingWork.front().callback == first.callback &&
+	       sameRunOptions(first.payload, pendingWork.front().payload)) {
+		PendingWork pending = pendingWork.front();
+		pendingWork.pop_front();
+
+		m_active.push_back(ActiveRequest());
+		ActiveRequest& request = m_active.back();
+		request.msg = pending.msg;
+		request.wrongApplication = false;
+		request.details = false;
+		request.subscribed = false;
+		request.critical = ScanTypes();
+		request.cancelled = false;
+		pending.payload.get("details", request.details);
+		pending.payload.get("subscribe", request.subscribed);
+		request.tally.perService = request.subscribed;
+		if (request.subscribed)
+			StartCounters();
+
+		MojErr err = (pending.instance->*(pending.callback))(pending.msg.get(), pending.payload);
+		if (err) {
+			MojString error;
+			MojErrToString(err, error);
+			LOG_WARNING(MSGID_BUS_CLIENT_ERROR, 1,
+					PMLOGKS("error", error.data()),
+					"Rejected service call: %s", error.data());
+			if (pending.msg->replyError(err, error.data()) != MojErrNone)
+				LOG_WARNING(MSGID_SHUTDOWN_ERROR, 0, "Failed to reply to rejected service call");
+			UnwatchRequest(pending.msg.get());
+			request.msg.reset();
+		}
+		coalesced++;
+	}
+	m_currentLane = BulkLane;
+	m_dispatching = false;
+
+	// directories can't be added to configurators that are being scanned
+	m_bulkIndex.clear();
+	for (ScanGroups::const_iterator i = m_deferredScans.begin(); i != m_deferredScans.end(); ++i)
+		StartScans(i->firstConfigurator, i->useBundle);
+	m_deferredScans.clear();
+
+	LOG_DEBUG("Running %zu %s service calls together (%zu configurators, %zu calls still queued)",
+			coalesced, lane == InteractiveLane ? "interactive" : "bulk", m_configurators.size(), pendingWork.size());
+
+	// those that got nothing to wait for
+	ReplyToFinished();
+	RunNextConfigurator();
+}
+
+gboolean BusClient::TrimCallback(gpointer data)
+{
+	BusClient* client = static_cast<BusClient*>(data);
+	client->m_trimSource = 0;
+	client->TrimIdle();
+	return false;
+}
+
 gboolean BusClient::ShutdownCallback(gpointer data)
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
@@ -29,6 +29,14 @@
 #include "Configurator.h"
 #include "Flags.h"
 #include "Log.h"
+#include "StampIndex.h"
+#include "ConfigBundle.h"
+#include "ConfigWatcher.h"
+#include "DependencyTracker.h"
+#include "FirstUseIndex.h"
+#include "ServiceLimiter.h"
+#include <deque>
+#include <map>
 #include <vector>
 
 class BusClient : public MojReactorApp<MojGmainReactor>
@@ -53,14 +61,35 @@ public:
 	virtual ~BusClient();
 
 	MojDbClient&						GetDbClient();
-	MojRefCountedPtr<MojServiceRequest>	CreateRequest();
-	MojRefCountedPtr<MojServiceRequest>	CreateRequest(const char *forgedAppId);
+	StampIndex&							GetStampIndex();
+	StampIndex*							GetBootStampIndex(); // NULL without a boot id
+	FirstUseIndex&						GetFirstUseIndex();
+	ConfiguratorStats&					GetStats();
+	DependencyTracker&					GetDependencies();
+	PathTable&							GetPaths();
+	ServiceLimiter&						GetLimiter();
+	virtual MojRefCountedPtr<MojServiceRequest>	CreateRequest();
+	virtual MojRefCountedPtr<MojServiceRequest>	CreateRequest(const char *forgedAppId);
 	virtual MojErr						open();
 	virtual MojErr						handleArgs(const StringVec& args);
 	void								ConfiguratorComplete(Configurator *configurator);
 	void								ConfiguratorComplete(int configuratorIndex);
+	void								RunNextConfigurator();
+
+	// a package of a bulk scan got all of its results
+	void								PackageFinished();
+
+	// files the watcher saw changing while resident
+	void								ConfigsChanged(const ConfigWatcher::Changes& changes);
+
+protected:
+	// once the requests of a run have been replied to
+	virtual void						RunFinished();
 
 private:
+	// drives runs against a mock bus (bench/)
+	friend class BenchClient;
+
 	typedef enum {
 		Application,
 		Service,
@@ -74,8 +103,18 @@ private:
 	typedef enum {
 		ForceRescan, /// force all the configurators to run
 		LazyScan, /// only run those configurators that haven't run yet
+		SmartRescan, /// force those configurators to run whose content changed
 	} ConfigurationMode;
 
+	// one entry of a scan request
+	struct Package {
+		MojString id;
+		PackageType type;
+		PackageLocation location;
+		ConfigurationMode mode;
+	};
+	typedef std::vector<Package> Packages;
+
 	class BusMethods : public MojService::CategoryHandler
 	{
 	public:
@@ -88,7 +127,9 @@ private:
 		MojErr Rescan(MojServiceMessage* msg, MojObject& payload);
 		MojErr Scan(MojServiceMessage* msg, MojObject& payload);
 		MojErr ScanRequest(MojServiceMessage* msg, MojObject& payload, ConfigurationMode confmode);
+		MojErr ParsePackage(const MojObject& request, ConfigurationMode confmode, Package& package);
 		MojErr Unconfigure(MojServiceMessage* msg, MojObject& payload);
+		MojErr GetStats(MojServiceMessage* msg, MojObject& payload);
 
 		BusClient& m_client;
 	};
@@ -100,7 +141,62 @@ private:
 		MojObject payload;
 	};
 
-	typedef std::vector<PendingWork> PendingWorkCollection;
+	typedef std::deque<PendingWork> PendingWorkCollection;
+
+	// interactive calls (for a single package) are dispatched ahead of bulk ones
+	enum Lane {
+		InteractiveLane,
+		BulkLane,
+		LaneCount
+	};
+
+	// a package of a bulk scan, reported on its own once it is done
+	struct PackageProgress {
+		std::string id;
+		ConfigTally tally;
+		bool reported;
+	};
+
+	// a bus request served by the current run
+	struct ActiveRequest {
+		MojRefCountedPtr<MojServiceMessage> msg;
+		ConfigTally tally;
+		bool wrongApplication;
+		bool details; // reply with the failures
+		bool subscribed; // stream the packages as they are done
+		std::deque<PackageProgress> packages;
+
+		// replied to once the configurators of these types are done, the
+		// rest goes on in the background
+		ScanTypes critical;
+		ConfigTally criticalTally;
+
+		// the caller went away or the deadline passed
+		bool cancelled;
+	};
+	typedef std::deque<ActiveRequest> ActiveRequests;
+
+	// notices the caller of a request going away and its deadline passing,
+	// from the time it is queued until it is replied to
+	class RequestWatch : public MojSignalHandler
+	{
+	public:
+		RequestWatch(BusClient& client, MojServiceMessage* msg, guint deadlineMs);
+		~RequestWatch();
+
+		void Stop();
+
+		MojServiceMessage::CancelSignal::Slot<RequestWatch> m_cancelSlot;
+
+	private:
+		MojErr HandleCancel(MojServiceMessage* msg);
+		static gboolean ExpiredCallback(gpointer data);
+
+		BusClient& m_client;
+		MojServiceMessage* m_msg;
+		guint m_deadlineSource;
+	};
+	typedef std::map<MojServiceMessage*, MojRefCountedPtr<RequestWatch> > RequestWatches;
 
 	static const char* const SERVICE_NAME;
 	static const char* const ROOT_BASE_DIR;
@@ -121,12 +217,55 @@ private:
 	static const char* const SERVICES_DIR;
 	static const char* const CONF_SUBDIR;
 
+	// every configuration directory below a base directory
+	static const char* const CONFIG_DIRS[];
+	static const size_t CONFIG_DIR_COUNT;
+
 	typedef MojReactorApp<MojGmainReactor> Base;
 	typedef MojRefCountedPtr<Configurator> ConfiguratorPtr;
 	typedef std::vector<ConfiguratorPtr> ConfiguratorCollection;
+	typedef std::map<ScanType, size_t> InFlightWindows;
+
+	// configurators of the current run by directory & run type
+	typedef std::map<std::string, size_t> ConfiguratorIndex;
+
+	// scans held back until every request of a coalesced run has added its configurators
+	struct ScanGroup {
+		size_t firstConfigurator;
+		bool useBundle;
+	};
+	typedef std::vector<ScanGroup> ScanGroups;
+
+	// configuration directories walked one after the other by a single
+	// worker - owned by the main loop, the worker only touches the
+	// directories & entries of the targets
+	struct ScanTarget {
+		ConfiguratorPtr configurator;
+		size_t index; // of the directory at the configurator
+		std::string directory;
+		bool folderFound;
+		DirScanner::Entries entries;
+		gint64 scanTime;
+		DirScanner::Directories directories;
+	};
+	struct ScanJob {
+		BusClient *client;
+		std::vector<ScanTarget> targets;
+		bool updateBundle;
+	};
+	typedef std::vector<ConfigBundle::Section> BundleSections;
+
+	static const int SCAN_WORKERS;
+	static const gint64 RUN_SLICE_US;
+	static const guint DEADLINE_CHECK_MS;
+	static const guint COUNTERS_INTERVAL_MS;
+	static const guint IDLE_TRIM_MIN_MS;
 
 	std::string appConfDir(const MojString& appId, PackageType type, PackageLocation location);
 
+	// the configuration trees are looked for below m_root
+	std::string RootDir(const char* dir) const;
+
 	static Configurator::ConfigType PackageTypeToConfigType(PackageType type)
 	{
 		switch(type) {
@@ -140,16 +279,64 @@ private:
 		}
 	}
 
+	static Configurator::RunType RunTypeFor(ConfigurationMode confmode);
+	static std::string IndexKey(const std::string& directory, Configurator::RunType runType, bool bootCache);
+
+	// the configuration directories of the types in bitmask, in the order
+	// they go into a run
+	static void WantedDirs(ScanTypes bitmask, AdditionalFileTypes types, std::vector<const char*>& wanted);
+
+	void BeginRun();
 	void Run(ScanTypes bitmask);
 	void Scan(ConfigurationMode confmode, const MojString& appid, PackageType type, PackageLocation location);
+	void ScanPackages(const Packages& packages);
 	void ScanDir(const MojString& id, Configurator::RunType scanType, const std::string &dirBase, ScanTypes bitmask, Configurator::ConfigType configType, AdditionalFileTypes types = None);
+	void AddConfiguratorFor(const char* subdir, const std::string& id, Configurator::RunType runType, const std::string& baseDir, Configurator::ConfigType configType);
+	bool AddConfigurator(const ConfiguratorPtr& configurator, ScanType type, Configurator::RunType runType);
+	void AddDbKindConfigurator(DbKindConfigurator *configurator, Configurator::RunType runType);
+	void AddDbPermissionsConfigurator(DbPermissionsConfigurator *configurator, Configurator::RunType runType);
+	void StartScans(size_t firstConfigurator, bool useBundle);
+	void UpdateBundle();
 	void Unconfigure(const MojString& appId, PackageType type, PackageLocation location, ScanTypes bitmask);
 
-	void RunNextConfigurator();
+	void AbortShutdown();
 	void ScheduleShutdown();
+	void ScheduleTrim(guint delayMs);
+	void TrimIdle();
+	void StartWatching();
+	void RunChanges();
+	void ScheduleDispatch();
+	bool HasPending() const;
+	void DispatchPending();
+	void DispatchLane(Lane lane);
+	void WatchRequest(MojServiceMessage* msg, const MojObject& payload);
+	void UnwatchRequest(MojServiceMessage* msg);
+	void CancelRequest(MojServiceMessage* msg, bool expired);
+	void ReplyToRequests();
+	void ReplyToFinished();
+	void Reply(ActiveRequest& request);
+	void ReportProgress();
+	void StartCounters();
+	bool ReportCounters();
+	void ReportCompletion(const Configurator& configurator);
+	MojErr ProgressToJson(const ConfigTally& tally, MojObject& progress) const;
+	MojErr ResultToJson(const ConfigTally& tally, MojObject& result) const;
+	ActiveRequest* CurrentRequest();
+
+	bool RunConfigurators();
+	bool CheckDeadlines();
+	void CompactReady();
+	void ClearConfigurators();
 
 	static gboolean IterateConfiguratorsCallback(gpointer data);
+	static gboolean DeadlineCallback(gpointer data);
 	static gboolean ShutdownCallback(gpointer data);
+	static gboolean TrimCallback(gpointer data);
+	static gboolean DispatchCallback(gpointer data);
+	static gboolean ProgressCallback(gpointer data);
+	static gboolean CountersCallback(gpointer data);
+	static void     ScanWorker(gpointer job, gpointer data);
+	static gboolean ScanCompleteCallback(gpointer job);
 
 	void ConfiguratorComplete(ConfiguratorCollection::iterator configurator);
 
@@ -159,13 +346,58 @@ private:
     MojDbServiceClient           m_tempDbClient;
 	ConfiguratorCollection       m_configurators;
 	size_t                       m_configuratorsCompleted;
+	std::vector<size_t>          m_ready; // slots of the configurators not completed yet
+	size_t                       m_readyCursor;
+	guint                        m_runSource;
+	bool                         m_runRequested;
+	guint                        m_deadlineSource;
 	MojRefCountedPtr<BusMethods> m_methods;
 	bool						 m_launchedAsService;
-	MojRefCountedPtr<MojServiceMessage> m_msg;
 	bool m_shuttingDown;
-	bool m_wrongAplication;
-	PendingWorkCollection m_pending;
+	PendingWorkCollection m_lanes[LaneCount];
+	ActiveRequests m_active;
+	RequestWatches m_watches;
+	ConfiguratorIndex m_configuratorIndex;
+	ConfiguratorIndex m_bulkIndex; // shared by the packages of bulk scans until their scans start
+	guint m_progressSource;
+	guint m_countersSource;
+	ScanGroups m_deferredScans;
+	bool m_busy;
+	bool m_dispatching;
+	bool m_dispatchScheduled;
+	Lane m_runLane;     // the lane the run in progress was started for
+	Lane m_currentLane; // the lane of the calls being dispatched
+	bool m_joinedRun;   // whether interactive calls joined the bulk run in progress
+	MojService::CategoryHandler::Callback m_joinedCallback;
+	std::vector<Lane> m_configuratorLanes;
 	unsigned int m_timerTimeout;
+	StampIndex m_stampIndex;
+	StampIndex m_bootStamps; // for services not keeping their state across a reboot
+	bool m_bootCache;
+	FirstUseIndex m_firstUseIndex;
+	GThreadPool *m_scanPool;
+	ConfigBundle m_bundle;
+	BundleSections m_bundleUpdates;
+	InFlightWindows m_inFlightWindows;
+	bool m_batchPermissions;
+	guint m_requestTimeout; // ms, 0 waits forever
+	unsigned m_requestRetries;
+	ConfiguratorStats m_stats;
+	DependencyTracker m_dependencies;
+	PathTable m_paths;
+	ServiceLimiter m_limiter;
+	ConfiguratorStats::Timer m_runTimer;
+	bool m_runStarted;
+	bool m_resident;
+	guint m_idleTtl;     // seconds to stay around for the next call, 0 exits right away
+	guint m_trimSource;
+	unsigned m_trimLevel; // how much of the warm state was dropped while idle
+	bool m_idle;
+	ConfiguratorStats::Timer m_idleTimer;
+	gint64 m_lastIdleUs;  // how long the previous idle period lasted
+	std::string m_root;
+	ConfigWatcher m_watcher;
+	ConfigWatcher::Changes m_changes;
 };
 
 DECLARE_OPERATORS_FOR_FLAGS(BusClient::ScanTypes)
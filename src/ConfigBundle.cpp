@@ -0,0 +1,291 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ConfigBundle.h"
+#include "Configurator.h"
+#include "MappedFile.h"
+#include "StampIndex.h"
+#include "Log.h"
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const char* const ConfigBundle::BUNDLE_FILE    = ".config-bundle";
+const MojInt64    ConfigBundle::BUNDLE_VERSION = 1;
+
+/*
+ * {"version": 1,
+ *  "sections": [{"directory": "/etc/palm/db/kinds", "service": "com.palm.db", "exists": true,
+ *                "dirs": [{"path": ..., "mtime": ..., "nsec": ..., "size": ...}],
+ *                "files": [{"path": ..., "parent": ..., "mtime": ..., "nsec": ..., "size": ...,
+ *                           "hash": ..., "config": {...}}]}]}
+ */
+
+ConfigBundle::ConfigBundle(const std::string& cacheDir)
+	: m_bundlePath(cacheDir + BUNDLE_FILE),
+	  m_loaded(false),
+	  m_dirty(false)
+{
+}
+
+ConfigBundle::~ConfigBundle()
+{
+}
+
+void ConfigBundle::Load()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	if (m_loaded)
+		return;
+	m_loaded = true;
+
+	MappedFile file;
+	if (!file.Open(m_bundlePath, MappedFile::MapLarge)) {
+		LOG_DEBUG("No configuration bundle in %s", m_bundlePath.c_str());
+		return;
+	}
+
+	MojObject bundle;
+	MojInt64 version = 0;
+	MojObject sections;
+	if (bundle.fromJson(file.Data(), file.Length()) != MojErrNone ||
+	    !bundle.get("version", version) || version != BUNDLE_VERSION ||
+	    !bundle.get("sections", sections)) {
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 1,
+				PMLOGKS("bundle", m_bundlePath.c_str()),
+				"Ignoring unreadable configuration bundle %s", m_bundlePath.c_str());
+		return;
+	}
+
+	for (MojObject::ConstArrayIterator i = sections.arrayBegin(); i != sections.arrayEnd(); ++i) {
+		MojString directory;
+		if (i->getRequired("directory", directory) == MojErrNone)
+			m_sections[directory.data()] = *i;
+	}
+
+	LOG_DEBUG("Loaded %zu sections from configuration bundle %s", m_sections.size(), m_bundlePath.c_str());
+}
+
+void ConfigBundle::Clear()
+{
+	m_sections.clear();
+	m_loaded = false;
+	m_dirty = false;
+}
+
+bool ConfigBundle::Save()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	if (!m_dirty)
+		return true;
+
+	MojErr err;
+	MojObject sections(MojObject::TypeArray);
+	for (SectionMap::const_iterator i = m_sections.begin(); i != m_sections.end(); ++i) {
+		err = sections.push(i->second);
+		if (err)
+			return false;
+	}
+
+	MojObject bundle;
+	MojString json;
+	err = bundle.putInt("version", BUNDLE_VERSION);
+	if (err == MojErrNone)
+		err = bundle.put("sections", sections);
+	if (err == MojErrNone)
+		err = bundle.toJson(json);
+	if (err)
+		return false;
+
+	if (!MappedFile::WriteAtomically(m_bundlePath, json.data(), json.length()))
+		return false;
+
+	m_dirty = false;
+	LOG_DEBUG("Saved %zu sections to configuration bundle %s", m_sections.size(), m_bundlePath.c_str());
+	return true;
+}
+
+bool ConfigBundle::Apply(Configurator& configurator)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	SectionMap::const_iterator i = m_sections.find(configurator.ConfigDirectory());
+	if (i == m_sections.end())
+		return false;
+
+	const MojObject& section = i->second;
+	MojString service;
+	if (section.getRequired("service", service) != MojErrNone || strcmp(service.data(), configurator.ServiceName()) != 0)
+		return false;
+
+	if (!IsCurrent(section)) {
+		LOG_DEBUG("Configuration bundle is stale for %s", configurator.ConfigDirectory().c_str());
+		return false;
+	}
+
+	bool exists = false;
+	section.get("exists", exists);
+
+	DirScanner::Entries entries;
+	MojObject files;
+	section.get("files", files);
+	for (MojObject::ConstArrayIterator file = files.arrayBegin(); file != files.arrayEnd(); ++file) {
+		MojString path, parent;
+		MojInt64 hash = 0;
+		MojObject config;
+		if (file->getRequired("path", path) != MojErrNone || !file->get("config", config))
+			return false;
+		file->getRequired("parent", parent);
+		file->get("hash", hash);
+
+		entries.push_back(DirScanner::Entry());
+		entries.back().path = path.data();
+		entries.back().parent = parent.data();
+		configurator.Preload(entries.back().path, config, (uint64_t) hash);
+	}
+
+	LOG_DEBUG("%s :: %zu configurations loaded from the configuration bundle", configurator.ConfiguratorName(), entries.size());
+	configurator.ScanComplete(exists, entries);
+	return true;
+}
+
+void ConfigBundle::Update(const Section& update)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	// whatever happens the old section is out of date
+	if (m_sections.erase(update.directory) > 0)
+		m_dirty = true;
+
+	MojObject section;
+	MojObject dirs(MojObject::TypeArray);
+	MojObject files(MojObject::TypeArray);
+	MojErr err;
+	struct stat info;
+
+	for (DirScanner::Directories::const_iterator i = update.directories.begin(); i != update.directories.end(); ++i) {
+		MojObject dir;
+		if (stat(i->c_str(), &info) != 0)
+			return;
+		err = dir.putString("path", i->c_str());
+		if (err == MojErrNone)
+			err = PutStat(dir, info);
+		if (err == MojErrNone)
+			err = dirs.push(dir);
+		if (err)
+			return;
+	}
+
+	for (DirScanner::Entries::const_iterator i = update.entries.begin(); i != update.entries.end(); ++i) {
+		MappedFile contents;
+		MojObject file;
+		MojObject config;
+
+		// a config that doesn't parse keeps the whole directory out of the
+		// bundle so that it still gets reported on each boot
+		if (stat(i->path.c_str(), &info) != 0 || !contents.Open(i->path) ||
+		    config.fromJson(contents.Data(), contents.Length()) != MojErrNone) {
+			LOG_DEBUG("Not bundling %s - %s can't be parsed", update.directory.c_str(), i->path.c_str());
+			return;
+		}
+
+		err = file.putString("path", i->path.c_str());
+		if (err == MojErrNone)
+			err = file.putString("parent", i->parent.c_str());
+		if (err == MojErrNone)
+			err = PutStat(file, info);
+		if (err == MojErrNone)
+			err = file.putInt("hash", (MojInt64) StampIndex::Hash(contents.Data(), contents.Length()));
+		if (err == MojErrNone)
+			err = file.put("config", config);
+		if (err == MojErrNone)
+			err = files.push(file);
+		if (err)
+			return;
+	}
+
+	err = section.putString("directory", update.directory.c_str());
+	if (err == MojErrNone)
+		err = section.putString("service", update.service.c_str());
+	if (err == MojErrNone)
+		err = section.putBool("exists", update.folderFound);
+	if (err == MojErrNone)
+		err = section.put("dirs", dirs);
+	if (err == MojErrNone)
+		err = section.put("files", files);
+	if (err)
+		return;
+
+	m_sections[update.directory] = section;
+	m_dirty = true;
+}
+
+bool ConfigBundle::IsCurrent(const MojObject& section)
+{
+	bool exists = false;
+	MojString directory;
+	struct stat info;
+
+	section.get("exists", exists);
+	if (!exists) {
+		// still missing?
+		return section.getRequired("directory", directory) == MojErrNone && stat(directory.data(), &info) != 0;
+	}
+
+	// adding or removing a file changes the mtime of its directory
+	MojObject dirs;
+	section.get("dirs", dirs);
+	for (MojObject::ConstArrayIterator i = dirs.arrayBegin(); i != dirs.arrayEnd(); ++i) {
+		MojString path;
+		if (i->getRequired("path", path) != MojErrNone || stat(path.data(), &info) != 0 ||
+		    !S_ISDIR(info.st_mode) || !StatMatches(*i, info))
+			return false;
+	}
+
+	MojObject files;
+	section.get("files", files);
+	for (MojObject::ConstArrayIterator i = files.arrayBegin(); i != files.arrayEnd(); ++i) {
+		MojString path;
+		if (i->getRequired("path", path) != MojErrNone || stat(path.data(), &info) != 0 || !StatMatches(*i, info))
+			return false;
+	}
+	return true;
+}
+
+bool ConfigBundle::StatMatches(const MojObject& stamp, const struct stat& info)
+{
+	MojInt64 mtime = -1, nsec = -1, size = -1;
+	stamp.get("mtime", mtime);
+	stamp.get("nsec", nsec);
+	stamp.get("size", size);
+	return mtime == (MojInt64) info.st_mtim.tv_sec &&
+		nsec == (MojInt64) info.st_mtim.tv_nsec &&
+		size == (MojInt64) info.st_size;
+}
+
+MojErr ConfigBundle::PutStat(MojObject& stamp, const struct stat& info)
+{
+	MojErr err = stamp.putInt("mtime", info.st_mtim.tv_sec);
+	MojErrCheck(err);
+	err = stamp.putInt("nsec", info.st_mtim.tv_nsec);
+	MojErrCheck(err);
+	err = stamp.putInt("size", info.st_size);
+	MojErrCheck(err);
+	return MojErrNone;
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef CONFIGBUNDLE_H_
+#define CONFIGBUNDLE_H_
+
+#include "core/MojObject.h"
+#include "DirScanner.h"
+#include <tr1/unordered_map>
+#include <string>
+
+class Configurator;
+
+/**
+ * Pre-parsed copy of the read-only configuration directories of the system
+ * image, so the boot run neither walks those directories nor reads & parses
+ * each config file again.
+ *
+ * The bundle is one JSON file in the cache directory with a section per
+ * configuration directory holding the parsed configs, their owners and the
+ * service they are sent to.  A section is only used while the mtimes of
+ * all its directories & files still match - a stale section is scanned as
+ * usual and regenerated from the scan results.
+ */
+class ConfigBundle
+{
+public:
+	struct Section {
+		std::string directory;
+		std::string service;
+		bool folderFound;
+		DirScanner::Directories directories;
+		DirScanner::Entries entries;
+	};
+
+	ConfigBundle(const std::string& cacheDir);
+	~ConfigBundle();
+
+	void Load();
+	void Clear();
+	bool Save();
+
+	// feeds the configurator from its section if that is up to date
+	bool Apply(Configurator& configurator);
+
+	// re-reads the files listed by a fresh scan into the section
+	void Update(const Section& section);
+
+private:
+	typedef std::tr1::unordered_map<std::string, MojObject> SectionMap;
+
+	static const char* const BUNDLE_FILE;
+	static const MojInt64    BUNDLE_VERSION;
+
+	static bool IsCurrent(const MojObject& section);
+	static bool StatMatches(const MojObject& stamp, const struct stat& info);
+	static MojErr PutStat(MojObject& stamp, const struct stat& info);
+
+	const std::string m_bundlePath;
+	SectionMap m_sections;
+	bool m_loaded;
+	bool m_dirty;
+};
+
+#endif /* CONFIGBUNDLE_H_ */
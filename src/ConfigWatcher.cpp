@@ -0,0 +1,328 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ConfigWatcher.h"
+#include "BusClient.h"
+#include "DirScanner.h"
+#include "Log.h"
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const guint    ConfigWatcher::SETTLE_DELAY_MS  = 250;
+const uint32_t ConfigWatcher::TREE_EVENTS      = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR;
+const uint32_t ConfigWatcher::DIRECTORY_EVENTS = IN_CREATE | IN_MOVED_TO | IN_ONLYDIR;
+
+ConfigWatcher::ConfigWatcher(BusClient& client)
+	: m_client(client),
+	  m_fd(-1),
+	  m_channel(NULL),
+	  m_readSource(0),
+	  m_flushTimer(0)
+{
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+	Stop();
+}
+
+bool ConfigWatcher::Start()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	if (m_fd != -1)
+		return true;
+
+	m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_fd == -1) {
+		LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 1,
+				PMLOGKS("error", strerror(errno)),
+				"Failed to set up watching the configuration directories: %s", strerror(errno));
+		return false;
+	}
+
+	m_channel = g_io_channel_unix_new(m_fd);
+	m_readSource = g_io_add_watch(m_channel, (GIOCondition) (G_IO_IN | G_IO_ERR | G_IO_HUP), &ConfigWatcher::ReadCallback, this);
+	return true;
+}
+
+void ConfigWatcher::Stop()
+{
+	if (m_flushTimer) {
+		g_source_remove(m_flushTimer);
+		m_flushTimer = 0;
+	}
+	if (m_readSource) {
+		g_source_remove(m_readSource);
+		m_readSource = 0;
+	}
+	if (m_channel) {
+		g_io_channel_unref(m_channel);
+		m_channel = NULL;
+	}
+	if (m_fd != -1) {
+		close(m_fd);
+		m_fd = -1;
+	}
+	m_watches.clear();
+	m_changes.clear();
+}
+
+bool ConfigWatcher::IsRunning() const
+{
+	return m_fd != -1;
+}
+
+void ConfigWatcher::WatchTree(const std::string& directory, const std::string& baseDir, const std::string& id, Configurator::ConfigType type)
+{
+	Watch owner;
+	owner.kind = Tree;
+	owner.baseDir = baseDir;
+	owner.id = id;
+	owner.configType = type;
+	owner.root = true;
+	AddTree(directory, owner, true, false);
+}
+
+void ConfigWatcher::WatchPackages(const std::string& directory, const std::string& confSubdir, Configurator::ConfigType type)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	Watch packages;
+	packages.kind = Packages;
+	packages.path = directory;
+	packages.confSubdir = confSubdir;
+	packages.configType = type;
+	packages.root = true;
+	if (!AddWatch(packages, DIRECTORY_EVENTS))
+		return;
+
+	DIR *dp = opendir(directory.c_str());
+	if (dp == NULL)
+		return;
+
+	struct dirent *dirp;
+	while ((dirp = readdir(dp)) != NULL) {
+		if (dirp->d_name[0] == '.')
+			continue;
+		if (dirp->d_type == DT_DIR || dirp->d_type == DT_UNKNOWN)
+			AddPackage(directory + "/" + dirp->d_name, packages, false);
+	}
+	closedir(dp);
+}
+
+bool ConfigWatcher::AddWatch(const Watch& watch, uint32_t events)
+{
+	if (m_fd == -1)
+		return false;
+
+	int wd = inotify_add_watch(m_fd, watch.path.c_str(), events);
+	if (wd == -1) {
+		// most of the directories are optional
+		if (errno != ENOENT && errno != ENOTDIR) {
+			LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+					PMLOGKS("directory", watch.path.c_str()),
+					PMLOGKS("error", strerror(errno)),
+					"Failed to watch %s: %s", watch.path.c_str(), strerror(errno));
+		}
+		return false;
+	}
+
+	m_watches[wd] = watch;
+	return true;
+}
+
+void ConfigWatcher::AddTree(const std::string& directory, const Watch& owner, bool root, bool queueFiles)
+{
+	Watch watch = owner;
+	watch.kind = Tree;
+	watch.path = directory;
+	watch.root = root;
+
+	// watch first so that nothing created meanwhile is missed
+	if (!AddWatch(watch, TREE_EVENTS))
+		return;
+
+	DirScanner::Entries entries;
+	DirScanner::Directories directories;
+	DirScanner::Scan(directory, entries, &directories);
+
+	watch.root = false;
+	for (DirScanner::Directories::const_iterator i = directories.begin(); i != directories.end(); ++i) {
+		if (*i == directory)
+			continue;
+		watch.path = *i;
+		AddWatch(watch, TREE_EVENTS);
+	}
+
+	if (queueFiles) {
+		for (DirScanner::Entries::const_iterator i = entries.begin(); i != entries.end(); ++i)
+			Queue(watch, i->path, false);
+	}
+	LOG_DEBUG("Watching %s (%zu directories)", directory.c_str(), directories.size());
+}
+
+void ConfigWatcher::AddPackage(const std::string& directory, const Watch& packages, bool queueFiles)
+{
+	Watch package = packages;
+	package.kind = Package;
+	package.path = directory;
+	package.id = directory.substr(directory.rfind('/') + 1);
+	package.baseDir = directory + packages.confSubdir;
+	package.root = false;
+	if (!AddWatch(package, DIRECTORY_EVENTS))
+		return;
+
+	// may already be there (or is being unpacked)
+	struct stat info;
+	const std::string configuration = package.baseDir.substr(0, package.baseDir.length() - 1);
+	if (stat(configuration.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+		AddTree(configuration, package, true, queueFiles);
+}
+
+void ConfigWatcher::Queue(const Watch& owner, const std::string& path, bool removed)
+{
+	Change& change = m_changes[path];
+	change.baseDir = owner.baseDir;
+	change.id = owner.id;
+	change.configType = owner.configType;
+	change.path = path;
+	change.removed = removed;
+
+	// wait for the tree to settle - a package install touches many files at once
+	if (m_flushTimer)
+		g_source_remove(m_flushTimer);
+	m_flushTimer = g_timeout_add(SETTLE_DELAY_MS, &ConfigWatcher::FlushCallback, this);
+}
+
+void ConfigWatcher::HandleEvent(const struct inotify_event* event)
+{
+	if (event->mask & IN_Q_OVERFLOW) {
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 0, "Configuration changes were lost, queueing every watched directory");
+		Rescan();
+		return;
+	}
+
+	WatchMap::iterator i = m_watches.find(event->wd);
+	if (i == m_watches.end())
+		return;
+
+	if (event->mask & IN_IGNORED) {
+		// the directory is gone
+		m_watches.erase(i);
+		return;
+	}
+	if (event->len == 0)
+		return;
+
+	// adding watches below may change the map
+	const Watch watch = i->second;
+	const std::string path = watch.path + "/" + event->name;
+	const bool created = (event->mask & (IN_CREATE | IN_MOVED_TO)) != 0;
+
+	if (event->mask & IN_ISDIR) {
+		if (!created)
+			return;
+
+		switch (watch.kind) {
+		case Tree:
+			AddTree(path, watch, false, true);
+			break;
+		case Packages:
+			LOG_DEBUG("New package %s", path.c_str());
+			AddPackage(path, watch, true);
+			break;
+		case Package:
+			if (path + "/" == watch.baseDir)
+				AddTree(path, watch, true, true);
+			break;
+		}
+		return;
+	}
+
+	if (watch.kind != Tree)
+		return;
+
+	if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+		Queue(watch, path, false);
+	else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+		Queue(watch, path, true);
+}
+
+void ConfigWatcher::Rescan()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	// AddTree() adds to the map - work from a copy
+	WatchMap watches(m_watches);
+	for (WatchMap::const_iterator i = watches.begin(); i != watches.end(); ++i) {
+		if (i->second.kind == Tree && i->second.root)
+			AddTree(i->second.path, i->second, true, true);
+	}
+}
+
+void ConfigWatcher::Flush()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	Changes changes;
+	changes.reserve(m_changes.size());
+	for (ChangeMap::const_iterator i = m_changes.begin(); i != m_changes.end(); ++i)
+		changes.push_back(i->second);
+	m_changes.clear();
+
+	LOG_DEBUG("%zu configuration files changed", changes.size());
+	m_client.ConfigsChanged(changes);
+}
+
+gboolean ConfigWatcher::ReadCallback(GIOChannel* channel, GIOCondition condition, gpointer data)
+{
+	ConfigWatcher *watcher = static_cast<ConfigWatcher*>(data);
+
+	if (condition & (G_IO_ERR | G_IO_HUP)) {
+		LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 0, "Lost the watch on the configuration directories");
+		watcher->m_readSource = 0;
+		return FALSE;
+	}
+
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		ssize_t length = read(watcher->m_fd, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+
+		for (const char *pos = buffer; pos < buffer + length; ) {
+			const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(pos);
+			watcher->HandleEvent(event);
+			pos += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	return TRUE;
+}
+
+gboolean ConfigWatcher::FlushCallback(gpointer data)
+{
+	ConfigWatcher *watcher = static_cast<ConfigWatcher*>(data);
+	watcher->m_flushTimer = 0;
+	watcher->Flush();
+	return FALSE;
+}
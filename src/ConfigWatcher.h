@@ -0,0 +1,111 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef CONFIGWATCHER_H_
+#define CONFIGWATCHER_H_
+
+#include "Configurator.h"
+#include <glib.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+struct inotify_event;
+
+/**
+ * Watches the configuration directories with inotify while the configurator
+ * stays resident, so that a package install only costs configuring the
+ * files it added or changed instead of a new process walking every tree.
+ *
+ * Changes are collected until the tree has been quiet for a moment and
+ * then handed to BusClient::ConfigsChanged() in one go.  Directories (and
+ * packages) created later are picked up along with the files in them.  If
+ * the kernel drops events every watched tree is queued again - files whose
+ * stamp still matches are skipped by the configurators anyway.
+ */
+class ConfigWatcher
+{
+public:
+	struct Change {
+		std::string baseDir;  // the configuration directories are below it
+		std::string id;       // package the file belongs to ("" for the system)
+		Configurator::ConfigType configType;
+		std::string path;
+		bool removed;
+	};
+	typedef std::vector<Change> Changes;
+
+	ConfigWatcher(BusClient& client);
+	~ConfigWatcher();
+
+	bool Start();
+	void Stop();
+	bool IsRunning() const;
+
+	// a single configuration directory below baseDir
+	void WatchTree(const std::string& directory, const std::string& baseDir, const std::string& id, Configurator::ConfigType type);
+
+	// a directory holding one package per subdirectory, each with its
+	// configuration directories below confSubdir
+	void WatchPackages(const std::string& directory, const std::string& confSubdir, Configurator::ConfigType type);
+
+private:
+	enum WatchKind {
+		Tree,     // a configuration directory or one below it
+		Packages, // the directory the packages are installed to
+		Package,  // a package, waiting for its configuration to show up
+	};
+
+	struct Watch {
+		WatchKind kind;
+		std::string path;
+		std::string baseDir;
+		std::string id;
+		std::string confSubdir;
+		Configurator::ConfigType configType;
+		bool root;
+	};
+	typedef std::map<int, Watch> WatchMap;
+	typedef std::map<std::string, Change> ChangeMap;
+
+	static const guint    SETTLE_DELAY_MS;
+	static const uint32_t TREE_EVENTS;
+	static const uint32_t DIRECTORY_EVENTS;
+
+	bool AddWatch(const Watch& watch, uint32_t events);
+	void AddTree(const std::string& directory, const Watch& owner, bool root, bool queueFiles);
+	void AddPackage(const std::string& directory, const Watch& packages, bool queueFiles);
+	void Queue(const Watch& owner, const std::string& path, bool removed);
+	void HandleEvent(const struct inotify_event* event);
+	void Rescan();
+	void Flush();
+
+	static gboolean ReadCallback(GIOChannel* channel, GIOCondition condition, gpointer data);
+	static gboolean FlushCallback(gpointer data);
+
+	BusClient& m_client;
+	int m_fd;
+	GIOChannel* m_channel;
+	guint m_readSource;
+	guint m_flushTimer;
+	WatchMap m_watches;
+
+	// latest change per file since the last flush
+	ChangeMap m_changes;
+};
+
+#endif /* CONFIGWATCHER_H_ */
@@ -16,46 +16,90 @@
 
 #include "BusClient.h"
 #include "Configurator.h"
-#include "dirent.h"
-#include <fstream>
-#include <streambuf>
+#include "MappedFile.h"
+#include <errno.h>
 #include <unistd.h>
 #include <sys/stat.h>
-#include <utime.h>
 #include <algorithm>
 
 using namespace std;
 
-static std::string Replace(std::string input, const std::string& substr, const std::string& replacement)
+const size_t ConfiguratorCallback::POOL_MAX_FREE = 64;
+
+// the freed callback blocks by size (callbacks only live on the main loop)
+typedef std::map<size_t, std::vector<void*> > CallbackPool;
+
+static CallbackPool& GetCallbackPool()
+{
+	static CallbackPool pool;
+	return pool;
+}
+
+static size_t liveCallbacks = 0;
+
+void* ConfiguratorCallback::operator new(size_t size)
 {
-	size_t i;
-	size_t l;
+	std::vector<void*>& blocks = GetCallbackPool()[size];
+	if (blocks.empty())
+		return ::operator new(size);
+
+	void *block = blocks.back();
+	blocks.pop_back();
+	return block;
+}
+
+void ConfiguratorCallback::operator delete(void* block, size_t size)
+{
+	if (block == NULL)
+		return;
 
-	i = input.find(substr);
-	l = substr.length();
-	while (i != string::npos) {
-		input.replace(i, l, replacement);
-		i = input.find(substr, i + l);
+	std::vector<void*>& blocks = GetCallbackPool()[size];
+	if (blocks.size() >= POOL_MAX_FREE) {
+		::operator delete(block);
+		return;
 	}
+	blocks.push_back(block);
+}
 
-	return input;
+void ConfiguratorCallback::TrimPool()
+{
+	CallbackPool& pool = GetCallbackPool();
+	for (CallbackPool::iterator i = pool.begin(); i != pool.end(); ++i) {
+		for (std::vector<void*>::const_iterator block = i->second.begin(); block != i->second.end(); ++block)
+			::operator delete(*block);
+	}
+	pool.clear();
 }
 
+size_t ConfiguratorCallback::LiveCount()
+{
+	return liveCallbacks;
+}
 
 ConfiguratorCallback::ConfiguratorCallback(Configurator* configurator, const std::string& filePath)
 	: m_slot(this, &ConfiguratorCallback::ResponseWrapper),
-	  m_config(filePath),
+	  m_token(configurator->m_currentToken),
 	  m_handler(configurator),
+	  m_path(configurator->Paths().Intern(filePath)),
+	  m_pathGeneration(configurator->Paths().Generation()),
 	  m_delegateInvoked(false),
+      m_defaultCacheBehaviourUsed(false),
 	  m_unconfigure(false),
-	  m_configure(false),
-      m_defaultCacheBehaviourUsed(false)
+	  m_configure(false)
 {
 	assert(m_handler.get() != NULL);
+	liveCallbacks++;
 }
 
 ConfiguratorCallback::~ConfiguratorCallback()
 {
+	liveCallbacks--;
+}
+
+const std::string& ConfiguratorCallback::ConfigPath() const
+{
+	const PathTable& paths = m_handler->Paths();
+	return paths.Get(paths.Generation() == m_pathGeneration ? m_path : PathTable::NoHandle);
 }
 
 MojErr ConfiguratorCallback::DelegateResponse(MojObject& response, MojErr err)
@@ -64,7 +108,7 @@ MojErr ConfiguratorCallback::DelegateResponse(MojObject& response, MojErr err)
 		return MojErrAccessDenied;
 	m_delegateInvoked = true;
 	m_defaultCacheBehaviourUsed = false;
-	return m_handler->BusResponseAsync(m_config, response, err, &m_defaultCacheBehaviourUsed);
+	return m_handler->BusResponseAsync(m_token, response, err, &m_defaultCacheBehaviourUsed);
 }
 
 void ConfiguratorCallback::MarkConfigured()
@@ -82,8 +126,16 @@ void ConfiguratorCallback::UnmarkConfigured()
 MojErr ConfiguratorCallback::ResponseWrapper(MojObject &response, MojErr err)
 {
 	MojErr result = MojErrNone;
+	m_slot.cancel();
+
+	// timed out or given up on meanwhile - its stamp is left alone
+	const std::string& config = ConfigPath();
+	if (m_handler->FindPending(m_token) == NULL || config.empty()) {
+		LOG_DEBUG("%s :: dropping late response for %s", m_handler->ConfiguratorName(), config.c_str());
+		return MojErrNone;
+	}
+
 	try {
-		m_slot.cancel();
 		result = Response(response, err);
 	}  catch (const std::exception& e){
 		MojErrThrowMsg(MojErrInternal, "%s", e.what());
@@ -96,11 +148,11 @@ MojErr ConfiguratorCallback::ResponseWrapper(MojObject &response, MojErr err)
 
 	if (!m_defaultCacheBehaviourUsed) {
 		if (m_unconfigure) {
-			LOG_DEBUG("Unmarking %s as configured", m_config.c_str());
-			m_handler->UnmarkConfigured(m_config);
+			LOG_DEBUG("Unmarking %s as configured", config.c_str());
+			m_handler->UnmarkConfigured(config);
 		} else if (m_configure) {
-			LOG_DEBUG("Marking %s as configured", m_config.c_str());
-			m_handler->MarkConfigured(m_config);
+			LOG_DEBUG("Marking %s as configured", config.c_str());
+			m_handler->MarkConfigured(config);
 		}
 	}
 	return result;
@@ -121,35 +173,150 @@ MojErr DefaultConfiguratorCallback::Response(MojObject &response, MojErr err)
 	return MojErrNone;
 }
 
-Configurator::ConfigCollection Configurator::m_configureOk;
-Configurator::ConfigCollection Configurator::m_configureFailed;
+ConfigTally::ConfigTally()
+	: pending(0),
+	  ok(0),
+	  failed(0),
+	  skipped(0),
+	  sent(0),
+	  cancelled(0),
+	  perService(false)
+{
+}
+
+ConfigTally::ServiceCounts::ServiceCounts()
+	: queued(0),
+	  ok(0),
+	  failed(0),
+	  sent(0)
+{
+}
+
+void ConfigTally::AddService(const char* service, ConfiguratorStats::Result result, size_t count)
+{
+	if (!perService)
+		return;
+
+	ServiceCounts& counts = services[service];
+	switch (result) {
+	case ConfiguratorStats::Ok:
+		counts.ok += count;
+		break;
+	case ConfiguratorStats::Failed:
+		counts.failed += count;
+		break;
+	case ConfiguratorStats::Sent:
+		counts.sent += count;
+		break;
+	default:
+		break;
+	}
+}
+
+void ConfigTally::Queue(const char* service, size_t count)
+{
+	if (perService)
+		services[service].queued += count;
+}
+
+void ConfigTally::Cancel(const char* service, size_t count)
+{
+	cancelled += count;
+	if (!perService)
+		return;
+
+	// no longer waiting for a result
+	ServiceCounts& counts = services[service];
+	counts.queued -= std::min(counts.queued, count);
+}
+
+void ConfigTally::Add(ConfiguratorStats::Result result, size_t count)
+{
+	switch (result) {
+	case ConfiguratorStats::Ok:
+		ok += count;
+		break;
+	case ConfiguratorStats::Failed:
+		failed += count;
+		break;
+	case ConfiguratorStats::Skipped:
+		skipped += count;
+		break;
+	case ConfiguratorStats::Sent:
+		sent += count;
+		break;
+	default:
+		break;
+	}
+}
+
+size_t Configurator::m_configsSent = 0;
+size_t Configurator::m_configsSkipped = 0;
 
 void Configurator::ResetConfigStats()
 {
-	m_configureOk.clear();
-	m_configureFailed.clear();
+	m_configsSent = 0;
+	m_configsSkipped = 0;
 }
 
-const Configurator::ConfigCollection& Configurator::ConfigureOk()
+size_t Configurator::ConfigsSent()
 {
-	return m_configureOk;
+	return m_configsSent;
 }
 
-const Configurator::ConfigCollection& Configurator::ConfigureFailure()
+size_t Configurator::ConfigsSkipped()
 {
-	return m_configureFailed;
+	return m_configsSkipped;
+}
+
+
+const Configurator::PendingToken Configurator::NoToken = (Configurator::PendingToken) -1;
+
+const guint    Configurator::DEFAULT_TIMEOUT_MS = 5000;
+const unsigned Configurator::DEFAULT_RETRIES    = 2;
+const guint    Configurator::MAX_TIMEOUT_MS     = 600000;
+const unsigned Configurator::MAX_RETRIES        = 16;
+const guint    Configurator::BACKOFF_INITIAL_MS = 250;
+const guint    Configurator::BACKOFF_MAX_MS     = 4000;
+
+void ConfigTally::AddFailure(PathTable::Handle path, const char* service, MojErr err)
+{
+	if (failures.size() >= MAX_FAILURES)
+		return;
+
+	failures.push_back(Failure());
+	failures.back().path = path;
+	failures.back().service = service;
+	failures.back().err = err;
 }
 
 Configurator::Configurator(const string& id, ConfigType confType, RunType type, BusClient& busClient, const string& configDirectory)
 : m_busClient(busClient),
   m_id(id),
 	m_confType(confType),
+	m_pendingCount(0),
+	m_currentToken(NoToken),
+	m_timeoutUs((gint64) DEFAULT_TIMEOUT_MS * 1000),
+	m_maxRetries(DEFAULT_RETRIES),
+	m_blockedGeneration(0),
+	m_cancelled(false),
+	m_bootCache(false),
   m_currentType(type),
   m_completed(false),
 	m_configDir(configDirectory),
+    m_emptyConfigurator(false),
 	m_scanned(false),
-    m_emptyConfigurator(false)
+	m_scanning(false),
+	m_scansPending(0),
+	m_inFlightWindow(0),
+	m_slot(0)
 {
+	m_directories.push_back(ConfigDirectoryInfo());
+	m_directories.back().path = configDirectory;
+	m_directories.back().id = id;
+	m_directories.back().tally = NULL;
+	m_directories.back().scanned = false;
+
 	InitCacheDir();
 }
 
@@ -158,116 +325,417 @@ Configurator::~Configurator()
 	LOG_DEBUG("Destroying configurator %p", this);
 }
 
-ConfiguratorCallback* Configurator::CreateCallback(const std::string &filePath)
+void Configurator::Record(ConfiguratorStats::Phase phase, gint64 usec) const
 {
-	return new DefaultConfiguratorCallback(this, filePath);
+	m_busClient.GetStats().Record(ConfiguratorName(), ServiceName(), phase, usec);
 }
 
-void Configurator::InitCacheDir() const
+void Configurator::Count(ConfiguratorStats::Result result, size_t count) const
 {
-	MojMkDir(kCacheDir, kCacheDirPerms);
-	MojMkDir(kConfCacheDir, kCacheStampPerm);
+	m_busClient.GetStats().Count(ConfiguratorName(), ServiceName(), result, count);
+	for (std::vector<ConfigTally*>::const_iterator i = m_tallies.begin(); i != m_tallies.end(); ++i) {
+		(*i)->Add(result, count);
+		(*i)->AddService(ServiceName(), result, count);
+	}
 }
 
-bool Configurator::IsAlreadyConfigured(const std::string& confFile) const
+PathTable& Configurator::Paths() const
 {
-	if (!this->CanCacheConfiguratorStatus(confFile)) {
-		LOG_DEBUG("Configurator ignores caching - returning false");
-		return false;
+	return m_busClient.GetPaths();
+}
+
+void Configurator::CountConfig(ConfiguratorStats::Result result, PathTable::Handle path)
+{
+	Count(result);
+
+	PackageTallyMap::iterator package = m_packageTallies.find(path);
+	if (package == m_packageTallies.end())
+		return;
+
+	ConfigTally *tally = package->second;
+	tally->Add(result);
+	if (result == ConfiguratorStats::Ok || result == ConfiguratorStats::Failed) {
+		m_packageTallies.erase(package);
+		ReleasePackage(tally);
 	}
+}
 
-	std::string stamp = kConfCacheDir + Replace(confFile, "/", "_");
-	MojStatT stampInfo, confInfo;
+void Configurator::ReleasePackage(ConfigTally* tally)
+{
+	if (--tally->pending == 0)
+		m_busClient.PackageFinished();
+}
 
-	if (MojErrNone != MojStat(stamp.c_str(), &stampInfo))
-		return false;
+void Configurator::Failed(PathTable::Handle path, MojErr err)
+{
+	PackageTallyMap::const_iterator package = m_packageTallies.find(path);
+	if (package != m_packageTallies.end())
+		package->second->AddFailure(path, ServiceName(), err);
 
-	if (MojErrNone != MojStat(confFile.c_str(), &confInfo))
-		return false;
+	CountConfig(ConfiguratorStats::Failed, path);
+	for (std::vector<ConfigTally*>::const_iterator i = m_tallies.begin(); i != m_tallies.end(); ++i)
+		(*i)->AddFailure(path, ServiceName(), err);
+}
 
-	LOG_DEBUG("%s may already be configured - %s exists", confFile.c_str(), stamp.c_str());
-	return stampInfo.st_mtime >= confInfo.st_mtime;
+void Configurator::AddTally(ConfigTally* tally)
+{
+	tally->pending++;
+	m_tallies.push_back(tally);
 }
 
-void Configurator::MarkConfigured(const std::string &confFile) const
+void Configurator::ReleaseTallies()
+{
+	for (std::vector<ConfigTally*>::const_iterator i = m_tallies.begin(); i != m_tallies.end(); ++i)
+		(*i)->pending--;
+	m_tallies.clear();
+
+	// the packages don't wait for whatever got no result (the configurator
+	// was dropped) either
+	for (PackageTallyMap::const_iterator i = m_packageTallies.begin(); i != m_packageTallies.end(); ++i)
+		ReleasePackage(i->second);
+	m_packageTallies.clear();
+	for (ConfigDirectories::iterator i = m_directories.begin(); i != m_directories.end(); ++i) {
+		if (i->tally && !i->scanned)
+			ReleasePackage(i->tally);
+		i->tally = NULL;
+	}
+}
+
+bool Configurator::Serves(const ConfigTally* tally) const
 {
-	if (!CanCacheConfiguratorStatus(confFile))
+	return std::find(m_tallies.begin(), m_tallies.end(), tally) != m_tallies.end();
+}
+
+void Configurator::Cancel()
+{
+	if (m_cancelled)
 		return;
 
-	LOG_DEBUG("Attempting to mark '%s' as configured", confFile.c_str());
+	LOG_DEBUG("%s :: cancelled with %zu configurations not sent yet", ConfiguratorName(), m_configs.size() + m_blockedConfigs.size() + m_retries.size());
+	m_cancelled = true;
+	DropUnsent();
+}
 
-	MojStatT confFileInfo;
-	MojErr err;
+void Configurator::DropUnsent()
+{
+	ConfigCollection dropped;
+	dropped.swap(m_configs);
+	dropped.insert(dropped.end(), m_blockedConfigs.begin(), m_blockedConfigs.end());
+	m_blockedConfigs.clear();
+	for (RetryConfigs::const_iterator i = m_retries.begin(); i != m_retries.end(); ++i)
+		dropped.push_back(i->path);
+	m_retries.clear();
+
+	for (ConfigCollection::const_iterator i = dropped.begin(); i != dropped.end(); ++i) {
+		m_contentHashes.erase(*i);
+		m_preloaded.erase(*i);
+
+		PackageTallyMap::iterator package = m_packageTallies.find(*i);
+		if (package != m_packageTallies.end()) {
+			ConfigTally *tally = package->second;
+			tally->Cancel(ServiceName(), 1);
+			m_packageTallies.erase(package);
+			ReleasePackage(tally);
+		}
+	}
+	for (std::vector<ConfigTally*>::const_iterator i = m_tallies.begin(); i != m_tallies.end(); ++i)
+		(*i)->Cancel(ServiceName(), dropped.size());
+}
 
-	err = MojStat(confFile.c_str(), &confFileInfo);
+size_t Configurator::AddDirectory(const std::string& directory, const std::string& id, ConfigTally* tally)
+{
+	m_directories.push_back(ConfigDirectoryInfo());
+	m_directories.back().path = directory;
+	m_directories.back().id = id;
+	m_directories.back().tally = NULL;
+	m_directories.back().scanned = false;
+	SetDirectoryTally(m_directories.size() - 1, tally);
+	return m_directories.size() - 1;
+}
 
-#ifndef UTIME_NOW
-	/*
-		If we don't have futimens() then use futimes with msec resolution. Also the
-		last-access time will be set to 0 instead of "now".
-	*/
-	struct timeval *times;
-	struct timeval inherited[2];
+void Configurator::SetDirectoryTally(size_t directory, ConfigTally* tally)
+{
+	// held until the directory is scanned
+	m_directories[directory].tally = tally;
+	if (tally)
+		tally->pending++;
+}
 
-	if (err == MojErrNone) {
-		inherited[0].tv_usec = 0; // don't care about atime
-		inherited[0].tv_sec = 0;
-		inherited[1].tv_usec = confFileInfo.st_mtim.tv_nsec / 1000;
-		inherited[1].tv_sec = confFileInfo.st_mtim.tv_sec + 1;
+size_t Configurator::DirectoryCount() const
+{
+	return m_directories.size();
+}
 
-		times = inherited;
+void Configurator::SetInFlightWindow(size_t window)
+{
+	m_inFlightWindow = window;
+}
 
-//		MojLogDebug(m_log, "Inheriting timestamp of %d s, %d ms", (int)inherited[1].tv_sec, (int)inherited[1].tv_msec);
-	} else {
-		LOG_WARNING(MSG_CONFIGURATOR_WARNING, 1,
-				PMLOGKS("error", strerror(errno)),
-				"Using current time as timestamp - couldn't get timestamp of conf file (%s)", strerror(errno));
-		times = NULL;
+size_t Configurator::InFlightWindow() const
+{
+	return m_inFlightWindow ? m_inFlightWindow : DefaultInFlightWindow();
+}
+
+void Configurator::SetSlot(size_t slot)
+{
+	m_slot = slot;
+}
+
+size_t Configurator::Slot() const
+{
+	return m_slot;
+}
+
+void Configurator::SetRetryPolicy(guint timeoutMs, unsigned retries)
+{
+	m_timeoutUs = (gint64) timeoutMs * 1000;
+	m_maxRetries = retries;
+}
+
+void Configurator::SetBootCache(bool bootCache)
+{
+	m_bootCache = bootCache;
+}
+
+bool Configurator::IsTransient(MojErr err)
+{
+	if (err == MojErrTimedOut)
+		return true;
+
+	// the services report the system calls that failed them with the errno
+	// value as error code, which may or may not coincide with a MojErr -
+	// checked apart to not depend on either
+	switch ((int) err) {
+	case EAGAIN:
+	case EBUSY:
+	case ETIMEDOUT:
+	case ECONNREFUSED:
+		return true;
+	default:
+		return false;
 	}
+}
+
+bool Configurator::Retry(PathTable::Handle path)
+{
+	if (m_cancelled)
+		return false;
+
+	unsigned& attempts = m_attempts[path];
+	if (attempts >= m_maxRetries)
+		return false;
+
+	// doubled per attempt made so far, up to the cap
+	guint backoff = BACKOFF_INITIAL_MS;
+	for (unsigned i = 0; i < attempts && backoff < BACKOFF_MAX_MS; i++)
+		backoff *= 2;
+	if (backoff > BACKOFF_MAX_MS)
+		backoff = BACKOFF_MAX_MS;
+	attempts++;
+
+	LOG_DEBUG("%s :: retrying '%s' in %u ms (attempt %u of %u)", ConfiguratorName(), Paths().Get(path).c_str(), backoff, attempts, m_maxRetries);
+	m_retries.push_back(RetryConfig());
+	m_retries.back().path = path;
+	m_retries.back().dueAt = g_get_monotonic_time() + (gint64) backoff * 1000;
+	return true;
+}
 
-	string stamp = kConfCacheDir + Replace(confFile, "/", "_");
+void Configurator::Expire(PendingToken token)
+{
+	PendingConfig& pending = m_pendingConfigs[token];
+	const PathTable::Handle path = pending.path;
+	const std::string& filePath = Paths().Get(path);
+	const gint64 waited = pending.sentAt.Elapsed();
+
+	LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+			PMLOGKS("config", filePath.c_str()),
+			PMLOGKFV("waited", "%" G_GINT64_FORMAT, waited / 1000),
+			"%s :: no reply from %s for '%s' after %" G_GINT64_FORMAT " ms", ConfiguratorName(), ServiceName(), filePath.c_str(), waited / 1000);
+
+	// a late reply finds the serial of the slot changed and is dropped
+	const bool wake = m_busClient.GetLimiter().Release(ServiceName(), waited, true);
+	RemovePending(token);
+	m_contentHashes.erase(path);
+	if (!Retry(path)) {
+		Failed(path, MojErrTimedOut);
+		ConfigDone(filePath, false);
+	}
+	if (wake)
+		m_busClient.RunNextConfigurator();
+}
 
-	int stampFd = open(stamp.c_str(), O_CREAT | O_WRONLY | O_NOATIME, kCacheStampPerm);
-	if (stampFd == -1) {
-		MojLogError(m_log, "Failed to mark %s as configured: %s", confFile.c_str(), strerror(errno));
+void Configurator::CheckDeadlines()
+{
+	if (m_completed)
 		return;
+
+	bool changed = false;
+	if (m_timeoutUs > 0) {
+		for (size_t index = 0; index < m_pendingConfigs.size(); index++) {
+			if (m_pendingConfigs[index].inUse && m_pendingConfigs[index].sentAt.Elapsed() >= m_timeoutUs) {
+				Expire(index);
+				changed = true;
+			}
+		}
 	}
 
-	if (-1 == futimes(stampFd, times)) {
-		// fall through to close()
-		unlink(stamp.c_str());
-		LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 2,
-				PMLOGKS("file", confFile.c_str())),
-				PMLOGKS("error", strerror(errno)),
-				"Failed to create configured stamp for %s (timestamp change failed: %s)", confFile.c_str(), strerror(errno));
-	} else {
-		LOG_DEBUG("'%s' marked as configured (stamp '%s' created)", confFile.c_str(), stamp.c_str());
+	const gint64 now = g_get_monotonic_time();
+	for (RetryConfigs::iterator i = m_retries.begin(); i != m_retries.end(); ) {
+		if (i->dueAt <= now) {
+			m_configs.push_back(i->path);
+			i = m_retries.erase(i);
+			changed = true;
+		} else {
+			++i;
+		}
 	}
 
-#else
-	struct timespec *times;
-	struct timespec inherited[2];
+	if (changed)
+		Run();
+}
 
-	if (err == MojErrNone) {
-		inherited[0].tv_nsec = UTIME_NOW; // don't care about atime - linux bug prevents me from using UTIME_OMIT
-		inherited[0].tv_sec = 0; // linux bug
-		inherited[1].tv_nsec = confFileInfo.st_mtim.tv_nsec;
-		inherited[1].tv_sec = confFileInfo.st_mtim.tv_sec + 1;
+Configurator::PendingToken Configurator::CurrentConfig() const
+{
+	return m_currentToken;
+}
 
-		times = inherited;
+void Configurator::SetCurrentConfig(PendingToken token)
+{
+	m_currentToken = token;
+}
 
-//		MojLogDebug(m_log, "Inheriting timestamp of %d s, %d ns", (int)inherited[1].tv_sec, (int)inherited[1].tv_nsec);
+Configurator::PendingToken Configurator::AddPending(PathTable::Handle path)
+{
+	PendingToken token;
+	if (m_freeTokens.empty()) {
+		token = m_pendingConfigs.size();
+		m_pendingConfigs.push_back(PendingConfig());
+		m_pendingConfigs.back().serial = 0;
 	} else {
-		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 1,
-				PMLOGKS("error", strerror(errno)),
-				"Using current time as timestamp - couldn't get timestamp of conf file (%s)", strerror(errno));
-		times = NULL;
+		token = m_freeTokens.back();
+		m_freeTokens.pop_back();
 	}
 
-	string stamp = kConfCacheDir + Replace(confFile, "/", "_");
+	PendingConfig& pending = m_pendingConfigs[token];
+	pending.path = path;
+	pending.sentAt = ConfiguratorStats::Timer();
+	pending.serial++;
+	pending.inUse = true;
+	m_pendingCount++;
+	return token | ((PendingToken) pending.serial << 32);
+}
 
-	int stampFd = open(stamp.c_str(), O_CREAT | O_WRONLY | O_NOATIME, kCacheStampPerm);
-	if (stampFd == -1) {
+Configurator::PendingConfig* Configurator::FindPending(PendingToken token)
+{
+	const size_t index = (size_t) (token & 0xffffffff);
+	if (token == NoToken || index >= m_pendingConfigs.size())
+		return NULL;
+
+	PendingConfig& pending = m_pendingConfigs[index];
+	if (!pending.inUse || pending.serial != (uint32_t) (token >> 32))
+		return NULL;
+	return &pending;
+}
+
+void Configurator::RemovePending(PendingToken token)
+{
+	token &= 0xffffffff;
+	PendingConfig& pending = m_pendingConfigs[token];
+	pending.inUse = false;
+	pending.path = PathTable::NoHandle;
+	m_freeTokens.push_back(token);
+	m_pendingCount--;
+}
+
+size_t Configurator::DefaultInFlightWindow() const
+{
+	return 1;
+}
+
+void Configurator::FlushRequests()
+{
+}
+
+void Configurator::ConfigFound(const std::string&)
+{
+}
+
+void Configurator::ScanFinished()
+{
+}
+
+void Configurator::ConfigDone(const std::string&, bool)
+{
+}
+
+ConfiguratorCallback* Configurator::CreateCallback(const std::string &filePath)
+{
+	return new DefaultConfiguratorCallback(this, filePath);
+}
+
+MojErr Configurator::PrecheckConfig(const std::string&)
+{
+	return MojErrNone;
+}
+
+void Configurator::InitCacheDir() const
+{
+	// once per process rather than for every configurator
+	static bool initialized = false;
+	if (initialized)
+		return;
+	initialized = true;
+
+	MojMkDir(kCacheDir, kCacheDirPerms);
+	MojMkDir(kConfCacheDir, kCacheStampPerm);
+}
+
+// verifyContent - compare the content digest even if mtime & size still match
+bool Configurator::IsAlreadyConfigured(const std::string& confFile, bool verifyContent) const
+{
+	StampIndex *stamps = StampsFor(confFile);
+	if (!stamps) {
+		LOG_DEBUG("Configurator ignores caching - returning false");
+		return false;
+	}
+
+	StampIndex::Stamp stamp;
+	if (!stamps->Lookup(confFile, stamp))
+		return false;
+
+	MojStatT confInfo;
+	if (MojErrNone != MojStat(confFile.c_str(), &confInfo))
+		return false;
+
+	LOG_DEBUG("%s may already be configured - stamp found in index", confFile.c_str());
+	const bool statMatches = StampIndex::Matches(stamp, confInfo);
+	if (statMatches && !verifyContent)
+		return true;
+
+	// touched (e.g. restored from a backup or rewritten by an update) - only
+	// the bytes tell if it really has to be configured again
+	uint64_t hash;
+	if (!StampIndex::HashFile(confFile, hash) || hash != stamp.hash)
+		return false;
+
+	if (!statMatches) {
+		LOG_DEBUG("%s changed on disk but its content is the same", confFile.c_str());
+		StampIndex::FromStat(confInfo, hash, stamp);
+		stamps->Mark(confFile, stamp);
+	}
+	return true;
+}
+
+void Configurator::MarkConfigured(const std::string &confFile) const
+{
+	StampIndex *stamps = StampsFor(confFile);
+	if (!stamps)
+		return;
+
+	LOG_DEBUG("Attempting to mark '%s' as configured", confFile.c_str());
+
+	MojStatT confFileInfo;
+	if (MojErrNone != MojStat(confFile.c_str(), &confFileInfo)) {
 		LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 2,
 				PMLOGKS("file", confFile.c_str()),
 				PMLOGKS("error", strerror(errno)),
@@ -275,46 +743,41 @@ void Configurator::MarkConfigured(const std::string &confFile) const
 		return;
 	}
 
-	if (-1 == futimens(stampFd, times)) {
-		// fall through to close()
-		unlink(stamp.c_str());
+	// the content was hashed when it was read for sending
+	uint64_t hash;
+	ContentHashMap::const_iterator i = m_contentHashes.find(Paths().Find(confFile));
+	if (i != m_contentHashes.end()) {
+		hash = i->second;
+	} else if (!StampIndex::HashFile(confFile, hash)) {
 		LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 2,
 				PMLOGKS("file", confFile.c_str()),
 				PMLOGKS("error", strerror(errno)),
-				"Failed to create configured stamp for %s (timestamp change failed: %s)", confFile.c_str(), strerror(errno));
-	} else {
-		LOG_DEBUG("'%s' marked as configured (stamp '%s' created)", confFile.c_str(), stamp.c_str());
+				"Failed to mark %s as configured: %s", confFile.c_str(), strerror(errno));
+		return;
 	}
 
-	close(stampFd);
-#endif
+	StampIndex::Stamp stamp;
+	StampIndex::FromStat(confFileInfo, hash, stamp);
+	stamps->Mark(confFile, stamp);
+	LOG_DEBUG("'%s' marked as configured", confFile.c_str());
 }
 
 void Configurator::UnmarkConfigured(const std::string &confFile) const
 {
-	if (!CanCacheConfiguratorStatus(confFile))
+	StampIndex *stamps = StampsFor(confFile);
+	if (!stamps)
 		return;
 
-	string stamp = kConfCacheDir + Replace(confFile, "/", "_");
-	if (unlink(stamp.c_str()) == 0)
-    {
-		LOG_DEBUG("removed configured stamp for '%s'", confFile.c_str());
-    }
-	else
-    {
-		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
-				PMLOGKS("file", confFile.c_str()),
-				PMLOGKS("stamp", stamp.c_str()),
-				"failed to remove configured stamp for '%s' ('%s')", confFile.c_str(), stamp.c_str());
-    }
+	stamps->Unmark(confFile);
+	LOG_DEBUG("removed configured stamp for '%s'", confFile.c_str());
 }
 
 const std::string& Configurator::ParentId(const std::string& filePath) const
 {
-	ConfigMap::const_iterator i = m_parentDirMap.find(filePath);
-	if (i == m_parentDirMap.end() || i->second.empty())
+	ConfigMap::const_iterator i = m_parentDirMap.find(Paths().Find(filePath));
+	if (i == m_parentDirMap.end())
 		return m_id;
-	return i->second;
+	return Paths().Get(i->second);
 }
 
 bool Configurator::CanCacheConfiguratorStatus(const std::string &) const
@@ -323,58 +786,93 @@ bool Configurator::CanCacheConfiguratorStatus(const std::string &) const
 	return true;
 }
 
+bool Configurator::CachesPerBoot() const
+{
+	return false;
+}
+
+StampIndex* Configurator::StampsFor(const std::string& confFile) const
+{
+	if (CanCacheConfiguratorStatus(confFile))
+		return &m_busClient.GetStampIndex();
+	if (CachesPerBoot() && m_bootCache)
+		return m_busClient.GetBootStampIndex();
+	return NULL;
+}
+
 bool Configurator::Run()
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
 
+	if (m_scanning) {
+		// the scan results will schedule another run once they're in
+		return true;
+	}
+
 	if (!m_scanned) {
-        bool folderFound = GetConfigFiles("", m_configDir);
-		if (m_configs.empty()) {
-            if (folderFound) // Prevents double logging when folder is missing
-                LOG_DEBUG("No configurations found in %s", m_configDir.c_str());
-			m_emptyConfigurator = true;
-		} else {
-			m_emptyConfigurator = false;
+		for (size_t directory = 0; directory < m_directories.size(); directory++) {
+			DirScanner::Entries entries;
+			ConfiguratorStats::Timer scanTimer;
+			bool folderFound = DirScanner::Scan(m_directories[directory].path, entries);
+			Record(ConfiguratorStats::Scan, scanTimer.Elapsed());
+			ScanComplete(folderFound, entries, directory);
 		}
-		m_scanned = true;
 	}
 
+	if (!m_blockedConfigs.empty() && m_blockedGeneration != m_busClient.GetDependencies().Generation()) {
+		// something they may be waiting for is done - try them again
+		m_configs.insert(m_configs.end(), m_blockedConfigs.rbegin(), m_blockedConfigs.rend());
+		m_blockedConfigs.clear();
+	}
+
+	// keep the in-flight window full - replies call back into Run() to refill it
+	// within the share of the target service as well
+	while (!m_configs.empty() && m_pendingCount < InFlightWindow() && m_busClient.GetLimiter().Acquire(ServiceName()))
+		SendNextConfig();
+	FlushRequests();
+
 	if (m_configs.empty()) {
-		if (m_pendingConfigs.empty() && !m_completed) {
+		// blocked configs are retried from the Run() that follows a change
+		// of the dependencies, like pending ones wait for their responses
+		// and the ones to retry for CheckDeadlines()
+		if (m_pendingCount == 0 && m_blockedConfigs.empty() && m_retries.empty() && !m_completed) {
 			if (!m_emptyConfigurator) {
 				LOG_DEBUG("%s :: No more configurations", ConfiguratorName());
 			}
 			Complete();
 		} else {
-			LOG_DEBUG("%s :: %d configurations pending, m_completed = %d", ConfiguratorName(), m_pendingConfigs.size(), m_completed);
+			LOG_DEBUG("%s :: %zu configurations pending, %zu blocked, %zu to retry, m_completed = %d", ConfiguratorName(), m_pendingCount, m_blockedConfigs.size(), m_retries.size(), m_completed);
 		}
 		// nothing to do - already sent out all the requests
 		// just waiting for responses from services
-		return m_configs.empty();
-	}
-	// Read the config file
-	string filePath = m_configs.back();
-	m_configs.pop_back();
-	m_pendingConfigs.push_back(filePath);
-	string config = ReadFile(filePath);
-
-	LOG_DEBUG("%s :: Configuring '%s'", ConfiguratorName(), filePath.c_str());
-
-	// process it
-	MojErr err = MojErrNone;
-	switch (m_currentType) {
-	case Configure:
-	case Reconfigure:
-		err = ProcessConfig(filePath, config);
-		break;
-	case RemoveConfiguration:
-		err = ProcessConfigRemoval(filePath, config);
-		break;
 	}
+	return m_configs.empty();
+}
 
-	if (err) {
+void Configurator::SendNextConfig()
+{
+	const PathTable::Handle path = m_configs.back();
+	const std::string& filePath = Paths().Get(path);
+	m_configs.pop_back();
+	const PendingToken token = AddPending(path);
+
+	LOG_DEBUG("%s :: Configuring '%s' (%zu in flight)", ConfiguratorName(), filePath.c_str(), m_pendingCount);
+
+	ConfiguratorStats::Timer processTimer;
+	m_currentToken = token;
+	MojErr err = ProcessFile(path);
+	m_currentToken = NoToken;
+	Record(ConfiguratorStats::Process, processTimer.Elapsed());
+	if (err == MojErrWouldBlock) {
+		LOG_DEBUG("%s :: '%s' waits for its dependencies", ConfiguratorName(), filePath.c_str());
+		m_blockedConfigs.push_back(path);
+		m_blockedGeneration = m_busClient.GetDependencies().Generation();
+		m_busClient.GetLimiter().Cancel(ServiceName());
+		RemovePending(token);
+		m_contentHashes.erase(path);
+	} else if (err) {
 		if (MojErrInProgress == err) {
-			m_configureOk.push_back(config);
+			CountConfig(ConfiguratorStats::Ok, path);
 			LOG_DEBUG("Skipping config file: %s", filePath.c_str());
 		}
 		else
@@ -382,111 +880,220 @@ bool Configurator::Run()
 			MojString errorMsg;
 			MojErrToString(err, errorMsg);
 			LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 2,
-					PMLOGKS("config", config.c_str()),
+					PMLOGKS("config", filePath.c_str()),
 					PMLOGKS("error", errorMsg.data()),
-					"Failed to process config: %s (error: %s)", config.c_str(), errorMsg.data());
+					"Failed to process config: %s (error: %s)", filePath.c_str(), errorMsg.data());
 	
 			// Skip this file and keep going!
-			m_configureFailed.push_back(filePath);
+			Failed(path, err);
 		}
-		m_pendingConfigs.pop_back();
-		return Run();
+		// no reply will come for this file - free its slot in the window
+		m_busClient.GetLimiter().Cancel(ServiceName());
+		RemovePending(token);
+		m_contentHashes.erase(path);
+		ConfigDone(filePath, MojErrInProgress == err);
+	} else {
+		m_configsSent++;
+		CountConfig(ConfiguratorStats::Sent, path);
+		FindPending(token)->sentAt = ConfiguratorStats::Timer();
 	}
-	return m_configs.empty();
+}
+
+MojErr Configurator::ProcessFile(PathTable::Handle path)
+{
+	const std::string& filePath = Paths().Get(path);
+	MojObject config;
+	uint64_t hash;
+
+	if (m_currentType != RemoveConfiguration) {
+		MojErr err = PrecheckConfig(filePath);
+		if (err)
+			return err;
+	}
+
+	PreloadedMap::iterator preloaded = m_preloaded.find(path);
+	if (preloaded != m_preloaded.end()) {
+		config.swap(preloaded->second.config);
+		hash = preloaded->second.hash;
+		m_preloaded.erase(preloaded);
+	} else {
+		MojErr err = ReadConfig(path, config, hash);
+		MojErrCheck(err);
+	}
+	if (StampsFor(filePath))
+		m_contentHashes[path] = hash;
+
+	// process it
+	MojErr err;
+	if (m_currentType == RemoveConfiguration)
+		err = ProcessConfigRemoval(filePath, config);
+	else
+		err = ProcessConfig(filePath, config);
+
+	// keep what has been read for the next attempt
+	if (err == MojErrWouldBlock)
+		Preload(filePath, config, hash);
+	return err;
+}
+
+MojErr Configurator::ReadConfig(PathTable::Handle path, MojObject& config, uint64_t& hash)
+{
+	const std::string& filePath = Paths().Get(path);
+	MappedFile file;
+	ConfiguratorStats::Timer readTimer;
+	bool opened = file.Open(filePath);
+	Record(ConfiguratorStats::Read, readTimer.Elapsed());
+	if (!opened) {
+		const int error = errno;
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+				PMLOGKS("config", filePath.c_str()),
+				PMLOGKS("error", strerror(error)),
+				"Failed to read config: %s (%s)", filePath.c_str(), strerror(error));
+		MojErrThrow((MojErr) error);
+	}
+	hash = StampIndex::Hash(file.Data(), file.Length());
+
+	ConfiguratorStats::Timer parseTimer;
+	MojErr err = config.fromJson(file.Data(), file.Length());
+	Record(ConfiguratorStats::Parse, parseTimer.Elapsed());
+	MojErrCheck(err);
+	return MojErrNone;
+}
+
+const MojObject* Configurator::PeekConfig(const std::string& filePath)
+{
+	const PathTable::Handle path = Paths().Intern(filePath);
+	PreloadedMap::iterator preloaded = m_preloaded.find(path);
+	if (preloaded != m_preloaded.end())
+		return &preloaded->second.config;
+
+	MojObject config;
+	uint64_t hash;
+	if (ReadConfig(path, config, hash) != MojErrNone)
+		return NULL;
+
+	// kept for ProcessConfig()
+	PreloadedConfig& entry = m_preloaded[path];
+	entry.config.swap(config);
+	entry.hash = hash;
+	return &entry.config;
 }
 
 MojErr Configurator::ProcessConfig(const std::string &filePath, const std::string &json)
+{
+	return ProcessConfig(filePath, json.data(), json.length());
+}
+
+MojErr Configurator::ProcessConfigRemoval(const std::string &filePath, const std::string &json)
+{
+	return ProcessConfigRemoval(filePath, json.data(), json.length());
+}
+
+MojErr Configurator::ProcessConfig(const std::string &filePath, const MojChar* json, gsize length)
 {
 	MojObject parsed;
-	MojErr err = parsed.fromJson(json.c_str());
+	ConfiguratorStats::Timer parseTimer;
+	MojErr err = parsed.fromJson(json, length);
+	Record(ConfiguratorStats::Parse, parseTimer.Elapsed());
 	MojErrCheck(err);
 
 	return ProcessConfig(filePath, parsed);
 }
 
-MojErr Configurator::ProcessConfigRemoval(const std::string &filePath, const std::string &json)
+MojErr Configurator::ProcessConfigRemoval(const std::string &filePath, const MojChar* json, gsize length)
 {
 	MojObject parsed;
-	MojErr err = parsed.fromJson(json.c_str());
+	ConfiguratorStats::Timer parseTimer;
+	MojErr err = parsed.fromJson(json, length);
+	Record(ConfiguratorStats::Parse, parseTimer.Elapsed());
 	MojErrCheck(err);
 
 	return ProcessConfigRemoval(filePath, parsed);
 }
 
-// returns whether folder exists or not
-bool Configurator::GetConfigFiles(const string& parent, const string& directory)
+const std::string& Configurator::ConfigDirectory(size_t directory) const
 {
-	LOG_TRACE("Entering function %s", __FUNCTION__);
-
-	DIR* dp = NULL;
-	struct dirent* dirp = NULL;
-	struct stat stat_buf;
+	return m_directories[directory].path;
+}
 
-	if((dp  = opendir(directory.c_str())) == NULL) {
-		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
-				PMLOGKS("directory", directory.c_str()),
-				PMLOGKS("parent", parent.c_str()),
-				"Failed to open directory: %s, under %s", directory.c_str(), parent.c_str());
-        return false;
-	}
+void Configurator::BeginScan()
+{
+	m_scansPending++;
+	m_scanning = true;
+}
 
-    LOG_DEBUG("Reading config files in '%s' under '%s'", directory.c_str(), parent.c_str());
-
-    while ((dirp = readdir(dp)) != NULL) {
-		string filename = dirp->d_name;
-		if (filename != "." && filename != "..") {
-			string filePath = directory;
-			filePath.append("/");
-			filePath.append(filename);
-			if(0 == stat(filePath.c_str(), &stat_buf)) {
-				if (S_ISDIR(stat_buf.st_mode)) {
-					GetConfigFiles(filename, filePath);
-				} else {
-					if (! parent.empty())
-						m_parentDirMap[filePath] = parent;
-
-					// Check if the config file has already been processed
-					if (!(m_currentType == Configure && IsAlreadyConfigured(filePath))) {
-						LOG_DEBUG("Found configuration '%s'", filePath.c_str());
-						m_configs.push_back(filePath);
-					} else {
-						LOG_DEBUG("Skipping configuration '%s' because it has already run (cache stamp in %s exists)", filePath.c_str(), kConfCacheDir);
-					}
-				}
-			}
-			else {
-				LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 0, "Failed to get file information on: %s", filename.c_str());
-				break;
-			}
-		}
-	}
-	closedir(dp);
-    return true;
+void Configurator::Preload(const std::string& filePath, MojObject& config, uint64_t hash)
+{
+	PreloadedConfig& preloaded = m_preloaded[Paths().Intern(filePath)];
+	preloaded.config.swap(config);
+	preloaded.hash = hash;
 }
 
-const string Configurator::ReadFile(const string& filePath)
+void Configurator::ScanComplete(bool folderFound, const DirScanner::Entries& entries, size_t directory)
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
 
-	string contents;
-	ifstream file;
-	file.open(filePath.c_str());
+	ConfigDirectoryInfo& scanned = m_directories[directory];
+	const size_t found = m_configs.size();
+	for (DirScanner::Entries::const_iterator i = entries.begin(); i != entries.end(); ++i) {
+		const std::string& filePath = i->path;
+
+		// Check if the config file has already been processed
+		bool configured = false;
+		if (m_currentType == Configure)
+			configured = IsAlreadyConfigured(filePath, false);
+		else if (m_currentType == SmartReconfigure)
+			configured = IsAlreadyConfigured(filePath, true);
+
+		if (!configured) {
+			LOG_DEBUG("Found configuration '%s'", filePath.c_str());
+			const PathTable::Handle path = Paths().Intern(filePath);
+			if (!i->parent.empty())
+				m_parentDirMap[path] = Paths().Intern(i->parent);
+			else if (directory > 0)
+				m_parentDirMap[path] = Paths().Intern(scanned.id);
+			if (scanned.tally) {
+				m_packageTallies[path] = scanned.tally;
+				scanned.tally->pending++;
+			}
+			m_configs.push_back(path);
+			if (m_currentType != RemoveConfiguration)
+				ConfigFound(filePath);
+		} else {
+			LOG_DEBUG("Skipping configuration '%s' because it has already run (stamp in %s matches)", filePath.c_str(), kConfCacheDir);
+
+			// a copy from the bundle would stay around until the run is over
+			if (!m_preloaded.empty())
+				m_preloaded.erase(Paths().Find(filePath));
+			m_configsSkipped++;
+			Count(ConfiguratorStats::Skipped);
+			if (scanned.tally)
+				scanned.tally->Add(ConfiguratorStats::Skipped);
+		}
+	}
+
+	for (std::vector<ConfigTally*>::const_iterator i = m_tallies.begin(); i != m_tallies.end(); ++i)
+		(*i)->Queue(ServiceName(), m_configs.size() - found);
 
-	if (!file.good())
-		return contents;
+	// Prevents double logging when folder is missing
+	if (m_configs.size() == found && folderFound)
+		LOG_DEBUG("No configurations found in %s", scanned.path.c_str());
+	m_emptyConfigurator = m_configs.empty();
 
-	try {
-		file.seekg(0, ios::end);
-		contents.reserve(file.tellg());
-		file.seekg(0, ios::beg);
-	} catch (...) {
-	}
+	// found too late - nobody waits for them any more
+	if (m_cancelled)
+		DropUnsent();
 
-	contents.assign((istreambuf_iterator<char>(file)),
-                     istreambuf_iterator<char>());
+	if (scanned.tally && !scanned.scanned)
+		ReleasePackage(scanned.tally);
+	scanned.scanned = true;
 
-	file.close();
-	return contents;
+	if (m_scansPending > 0)
+		m_scansPending--;
+	m_scanning = m_scansPending > 0;
+	m_scanned = !m_scanning;
+	if (m_scanned)
+		ScanFinished();
 }
 
 void Configurator::Complete()
@@ -495,27 +1102,61 @@ void Configurator::Complete()
 	m_completed = true;
 }
 
-MojErr Configurator::BusResponseAsync(const std::string& config, MojObject& response, MojErr err, bool *cacheConfigured)
+bool Configurator::IsPending(PendingToken token)
+{
+	return FindPending(token) != NULL;
+}
+
+MojErr Configurator::ConfigResponse(PendingToken token, MojObject& response, MojErr err)
+{
+	bool cacheConfigured = false;
+	return BusResponseAsync(token, response, err, &cacheConfigured);
+}
+
+MojErr Configurator::BusResponseAsync(PendingToken token, MojObject& response, MojErr err, bool *cacheConfigured)
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
 
 	try {
-		// remove the config from the list
-		ConfigCollection::iterator i = find(m_pendingConfigs.begin(), m_pendingConfigs.end(), config);
-		if (i == m_pendingConfigs.end()) {
+		PendingConfig* pending = FindPending(token);
+		if (pending == NULL) {
+			// most likely timed out already - leave its stamp alone
 			LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 1,
-					PMLOGKS("for", config.c_str()),
-					"Response for %s but not in pending list", config.c_str());
-		} else {
-			LOG_DEBUG("Response for %s - removing from pending list", config.c_str());
-			m_pendingConfigs.erase(i);
+					PMLOGKFV("token", "%" G_GUINT64_FORMAT, token),
+					"Response for %s config %" G_GUINT64_FORMAT " but not in pending list", ConfiguratorName(), token);
+			*cacheConfigured = true;
+			return MojErrNone;
 		}
 
+		// remove the config from the list
+		const PathTable::Handle path = pending->path;
+		const std::string& config = Paths().Get(path);
+		LOG_DEBUG("Response for %s - removing from pending list", config.c_str());
+		const gint64 roundTrip = pending->sentAt.Elapsed();
+		Record(ConfiguratorStats::RoundTrip, roundTrip);
+		RemovePending(token);
+
 		bool success = true;
 		response.get("returnValue", success);
 
+		// other configurators may have been held back for this service
+		const bool wake = m_busClient.GetLimiter().Release(ServiceName(), roundTrip, err || !success);
+
+		bool retrying = false;
 		if (err || !success) {
-			m_configureFailed.push_back(config);
+			MojInt64 errorCode = MojErrInternal;
+			if (err)
+				errorCode = err;
+			else
+				response.get("errorCode", errorCode);
+
+			// the service may just not be up yet
+			if (IsTransient((MojErr) errorCode) && Retry(path)) {
+				retrying = true;
+				*cacheConfigured = true;
+			} else {
+				Failed(path, (MojErr) errorCode);
+			}
 
 			MojString json;
 			MojErrCheck(response.toJson(json));
@@ -524,7 +1165,7 @@ MojErr Configurator::BusResponseAsync(const std::string& config, MojObject& resp
 					PMLOGKFV("error", "%d", err),
 					"%s: %s (MojErr: %i)", config.c_str(), json.data(), err);
 		} else {
-			m_configureOk.push_back(config);
+			CountConfig(ConfiguratorStats::Ok, path);
 
 			*cacheConfigured = true;
 			if (m_currentType != RemoveConfiguration)
@@ -532,9 +1173,14 @@ MojErr Configurator::BusResponseAsync(const std::string& config, MojObject& resp
 			else
 				UnmarkConfigured(config);
 		}
+		m_contentHashes.erase(path);
+		if (!retrying)
+			ConfigDone(config, !err && success);
 
 		// do the next config
 		Run();
+		if (wake)
+			m_busClient.RunNextConfigurator();
 	} catch (const std::exception& e){
 		MojErrThrowMsg(MojErrInternal, "%s", e.what());
 	} catch (...) {
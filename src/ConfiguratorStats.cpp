@@ -0,0 +1,210 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ConfiguratorStats.h"
+#include "Log.h"
+#include <string.h>
+
+using namespace std;
+
+const char* const ConfiguratorStats::PHASE_NAMES[PhaseCount] = {
+	"scan", "read", "parse", "process", "roundTrip"
+};
+
+const char* const ConfiguratorStats::RESULT_NAMES[ResultCount] = {
+	"ok", "failed", "skipped", "sent"
+};
+
+ConfiguratorStats::Histogram::Histogram()
+	: m_count(0),
+	  m_total(0),
+	  m_max(0)
+{
+	memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+void ConfiguratorStats::Histogram::Add(gint64 usec)
+{
+	if (usec < 0)
+		usec = 0;
+
+	// bucket i holds [2^i, 2^(i+1)) microseconds, bucket 0 also holds 0
+	size_t bucket = 0;
+	for (gint64 v = usec; v > 1 && bucket < BUCKETS - 1; v >>= 1)
+		bucket++;
+
+	m_buckets[bucket]++;
+	m_count++;
+	m_total += usec;
+	if (usec > m_max)
+		m_max = usec;
+}
+
+gint64 ConfiguratorStats::Histogram::Percentile(unsigned percent) const
+{
+	if (m_count == 0)
+		return 0;
+
+	const size_t rank = (m_count * percent + 99) / 100;
+	size_t seen = 0;
+	for (size_t i = 0; i < BUCKETS; i++) {
+		seen += m_buckets[i];
+		if (seen >= rank) {
+			const gint64 upper = ((gint64) 2 << i) - 1;
+			return upper < m_max ? upper : m_max;
+		}
+	}
+	return m_max;
+}
+
+MojErr ConfiguratorStats::Histogram::ToJson(MojObject& histogram) const
+{
+	MojErr err = histogram.putInt("count", m_count);
+	MojErrCheck(err);
+	err = histogram.putInt("totalUs", m_total);
+	MojErrCheck(err);
+	err = histogram.putInt("p50Us", Percentile(50));
+	MojErrCheck(err);
+	err = histogram.putInt("p95Us", Percentile(95));
+	MojErrCheck(err);
+	err = histogram.putInt("maxUs", m_max);
+	MojErrCheck(err);
+	return MojErrNone;
+}
+
+ConfiguratorStats::Entry::Entry()
+{
+	memset(results, 0, sizeof(results));
+}
+
+ConfiguratorStats::ConfiguratorStats()
+{
+}
+
+ConfiguratorStats::~ConfiguratorStats()
+{
+}
+
+ConfiguratorStats::Entry& ConfiguratorStats::Lookup(const char* configurator, const char* service)
+{
+	std::string key(configurator);
+	key.append("/").append(service);
+
+	EntryMap::iterator i = m_entries.find(key);
+	if (i != m_entries.end())
+		return i->second;
+
+	Entry& entry = m_entries[key];
+	entry.configurator = configurator;
+	entry.service = service;
+	return entry;
+}
+
+void ConfiguratorStats::Record(const char* configurator, const char* service, Phase phase, gint64 usec)
+{
+	Lookup(configurator, service).phases[phase].Add(usec);
+}
+
+void ConfiguratorStats::Count(const char* configurator, const char* service, Result result, size_t count)
+{
+	if (count > 0)
+		Lookup(configurator, service).results[result] += count;
+}
+
+void ConfiguratorStats::RecordRun(gint64 usec)
+{
+	m_runs.Add(usec);
+}
+
+void ConfiguratorStats::Reset()
+{
+	m_entries.clear();
+	m_runs = Histogram();
+}
+
+MojErr ConfiguratorStats::ToJson(MojObject& stats) const
+{
+	MojErr err;
+	MojObject runs;
+	err = m_runs.ToJson(runs);
+	MojErrCheck(err);
+	err = stats.put("runs", runs);
+	MojErrCheck(err);
+
+	MojObject configurators(MojObject::TypeArray);
+	for (EntryMap::const_iterator i = m_entries.begin(); i != m_entries.end(); ++i) {
+		const Entry& entry = i->second;
+		MojObject obj;
+
+		err = obj.putString("configurator", entry.configurator.c_str());
+		MojErrCheck(err);
+		err = obj.putString("service", entry.service.c_str());
+		MojErrCheck(err);
+
+		for (int result = 0; result < ResultCount; result++) {
+			err = obj.putInt(RESULT_NAMES[result], entry.results[result]);
+			MojErrCheck(err);
+		}
+
+		for (int phase = 0; phase < PhaseCount; phase++) {
+			MojObject histogram;
+			err = entry.phases[phase].ToJson(histogram);
+			MojErrCheck(err);
+			err = obj.put(PHASE_NAMES[phase], histogram);
+			MojErrCheck(err);
+		}
+
+		err = configurators.push(obj);
+		MojErrCheck(err);
+	}
+	err = stats.put("configurators", configurators);
+	MojErrCheck(err);
+
+	return MojErrNone;
+}
+
+void ConfiguratorStats::LogSummary() const
+{
+	LOG_INFO(MSGID_CONFIGURATOR_STATS, 3,
+			PMLOGKFV("runs", "%zu", m_runs.Count()),
+			PMLOGKFV("p50Us", "%" G_GINT64_FORMAT, m_runs.Percentile(50)),
+			PMLOGKFV("maxUs", "%" G_GINT64_FORMAT, m_runs.Max()),
+			"Configuration runs");
+
+	for (EntryMap::const_iterator i = m_entries.begin(); i != m_entries.end(); ++i) {
+		const Entry& entry = i->second;
+		const Histogram& scan = entry.phases[Scan];
+		const Histogram& process = entry.phases[Process];
+		const Histogram& roundTrip = entry.phases[RoundTrip];
+
+		LOG_INFO(MSGID_CONFIGURATOR_STATS, 14,
+				PMLOGKS("configurator", entry.configurator.c_str()),
+				PMLOGKS("service", entry.service.c_str()),
+				PMLOGKFV("ok", "%zu", entry.results[Ok]),
+				PMLOGKFV("failed", "%zu", entry.results[Failed]),
+				PMLOGKFV("skipped", "%zu", entry.results[Skipped]),
+				PMLOGKFV("sent", "%zu", entry.results[Sent]),
+				PMLOGKFV("scans", "%zu", scan.Count()),
+				PMLOGKFV("scanMaxUs", "%" G_GINT64_FORMAT, scan.Max()),
+				PMLOGKFV("processP50Us", "%" G_GINT64_FORMAT, process.Percentile(50)),
+				PMLOGKFV("processP95Us", "%" G_GINT64_FORMAT, process.Percentile(95)),
+				PMLOGKFV("processMaxUs", "%" G_GINT64_FORMAT, process.Max()),
+				PMLOGKFV("roundTripP50Us", "%" G_GINT64_FORMAT, roundTrip.Percentile(50)),
+				PMLOGKFV("roundTripP95Us", "%" G_GINT64_FORMAT, roundTrip.Percentile(95)),
+				PMLOGKFV("roundTripMaxUs", "%" G_GINT64_FORMAT, roundTrip.Max()),
+				"%s timings", entry.configurator.c_str());
+	}
+}
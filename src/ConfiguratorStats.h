@@ -0,0 +1,115 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef CONFIGURATORSTATS_H_
+#define CONFIGURATORSTATS_H_
+
+#include "core/MojObject.h"
+#include <glib.h>
+#include <map>
+#include <string>
+
+/**
+ * Timings of the phases a config goes through (directory scan, read,
+ * parse, processing and the round trip to the target service), kept per
+ * configurator & service.
+ *
+ * Durations go into power-of-two histograms so the memory used doesn't
+ * grow with the number of configs - percentiles are reported as the upper
+ * bound of the bucket they fall in (capped by the largest value seen).
+ * Only used from the main loop.
+ */
+class ConfiguratorStats
+{
+public:
+	enum Phase {
+		Scan,
+		Read,
+		Parse,
+		Process,
+		RoundTrip,
+		PhaseCount
+	};
+
+	enum Result {
+		Ok,
+		Failed,
+		Skipped,
+		Sent,
+		ResultCount
+	};
+
+	// measures from construction
+	class Timer {
+	public:
+		Timer() : m_start(g_get_monotonic_time()) {}
+		gint64 Elapsed() const { return g_get_monotonic_time() - m_start; }
+	private:
+		gint64 m_start;
+	};
+
+	ConfiguratorStats();
+	~ConfiguratorStats();
+
+	void Record(const char* configurator, const char* service, Phase phase, gint64 usec);
+	void Count(const char* configurator, const char* service, Result result, size_t count = 1);
+
+	// a whole request, from the first configurator created to the reply
+	void RecordRun(gint64 usec);
+
+	MojErr ToJson(MojObject& stats) const;
+	void   LogSummary() const;
+	void   Reset();
+
+private:
+	class Histogram {
+	public:
+		Histogram();
+		void   Add(gint64 usec);
+		size_t Count() const { return m_count; }
+		gint64 Percentile(unsigned percent) const;
+		gint64 Max() const { return m_max; }
+		MojErr ToJson(MojObject& histogram) const;
+
+	private:
+		static const size_t BUCKETS = 40;
+
+		size_t m_count;
+		gint64 m_total;
+		gint64 m_max;
+		size_t m_buckets[BUCKETS];
+	};
+
+	struct Entry {
+		Entry();
+
+		std::string configurator;
+		std::string service;
+		Histogram phases[PhaseCount];
+		size_t results[ResultCount];
+	};
+	typedef std::map<std::string, Entry> EntryMap;
+
+	static const char* const PHASE_NAMES[PhaseCount];
+	static const char* const RESULT_NAMES[ResultCount];
+
+	Entry& Lookup(const char* configurator, const char* service);
+
+	EntryMap m_entries;
+	Histogram m_runs;
+};
+
+#endif /* CONFIGURATORSTATS_H_ */
@@ -19,6 +19,7 @@
 
 class BusClient;
 class DbKindConfigurator;
+class DbPermissionsConfigurator;
 class FileCacheConfigurator;
 class WatchConfigurator;
 
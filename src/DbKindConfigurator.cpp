@@ -25,6 +25,7 @@ static const char *MOJODB_TEMPDB_BUS_ADDRESS = "com.palm.tempdb";
 static const char *MOJODB_MEDIADB_BUS_ADDRESS = "com.webos.mediadb";
 static const char *MOJODB_PUTKIND_METHOD = "putKind";
 static const char *MOJODB_DELKIND_METHOD = "delKind";
+static const size_t DBKIND_INFLIGHT_WINDOW = 8;
 
 const char* DbKindConfigurator::ConfiguratorName() const
 {
@@ -36,6 +37,11 @@ const char* DbKindConfigurator::ServiceName() const
 	 return MOJODB_DB_BUS_ADDRESS;
 }
 
+size_t DbKindConfigurator::DefaultInFlightWindow() const
+{
+	return DBKIND_INFLIGHT_WINDOW;
+}
+
 typedef MojServiceRequest::ReplySignal::Slot<Configurator> ReplySlot;
 
 class DbKindConfiguratorResponse : public ConfiguratorCallback
@@ -58,7 +64,8 @@ public:
 
 DbKindConfigurator::DbKindConfigurator(const std::string& id, ConfigType confType, RunType type, BusClient& busClient, MojDbClient& dbClient, string configDirectory)
 : Configurator(id, confType, type, busClient, configDirectory),
-  m_dbClient(dbClient)
+  m_dbClient(dbClient),
+  m_delKind(MojObject::TypeObject)
 {
 }
 
@@ -110,15 +117,55 @@ MojErr DbKindConfigurator::ProcessConfig(const string& filePath, MojObject& para
 	err = CheckOwner(filePath, params, owner);
 	MojErrCheck(err);
 
+	// one call per kind - db8's batch method only takes data operations
+	// (put, get, del, merge, find, ...) and rejects a putKind inside it, and
+	// there is no bulk putKind, so the in-flight window is what keeps the
+	// round trips of the kinds overlapping
 	return m_busClient.CreateRequest(owner.c_str())->send(CreateCallback(filePath)->m_slot, ServiceName(), MOJODB_PUTKIND_METHOD, params);
 }
 
+void DbKindConfigurator::ConfigFound(const std::string& filePath)
+{
+	// permissions for this kind wait until it is registered - announced
+	// before any kind is sent so that they don't have to wait for the rest
+	const MojObject* kind = PeekConfig(filePath);
+	MojString id;
+	// (only once - a kind found again is still being registered)
+	const PathTable::Handle path = Paths().Intern(filePath);
+	if (kind && kind->getRequired("id", id) == MojErrNone && m_kindIds.find(path) == m_kindIds.end()) {
+		const Configurator *provider = this;
+		m_kindIds[path] = id.data();
+		m_busClient.GetDependencies().Providing(provider, id.data());
+	}
+}
+
+void DbKindConfigurator::ScanFinished()
+{
+	const Configurator *provider = this;
+	if (m_busClient.GetDependencies().Announced(provider))
+		m_busClient.RunNextConfigurator();
+}
+
+void DbKindConfigurator::ConfigDone(const std::string& filePath, bool success)
+{
+	KindIdMap::iterator i = m_kindIds.find(Paths().Find(filePath));
+	if (i == m_kindIds.end())
+		return;
+
+	// a kind that failed won't show up later in this run either
+	LOG_DEBUG("%s :: kind %s %s", ConfiguratorName(), i->second.c_str(), success ? "registered" : "failed");
+	const Configurator *provider = this;
+	bool wake = m_busClient.GetDependencies().Provided(provider, i->second);
+	m_kindIds.erase(i);
+	if (wake)
+		m_busClient.RunNextConfigurator();
+}
+
 MojErr DbKindConfigurator::ProcessConfigRemoval(const string& filePath, MojObject& params)
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
 	MojErr err;
 	MojString id;
-	MojObject delKind;
 	std::string owner;
 
 	err = CheckOwner(filePath, params, owner);
@@ -131,10 +178,10 @@ MojErr DbKindConfigurator::ProcessConfigRemoval(const string& filePath, MojObjec
 		MojErrThrowMsg(err, "Failed to remove db kind for %s - id is missing", creator.c_str());
 	}
 
-	err = delKind.putString("id", id);
+	err = m_delKind.putString("id", id);
 	MojErrCheck(err);
 
-	return m_busClient.CreateRequest(owner.c_str())->send(CreateCallback(filePath)->m_slot, ServiceName(), MOJODB_DELKIND_METHOD, delKind);
+	return m_busClient.CreateRequest(owner.c_str())->send(CreateCallback(filePath)->m_slot, ServiceName(), MOJODB_DELKIND_METHOD, m_delKind);
 }
 
 ////////////////////////////////////////////////
@@ -166,3 +213,8 @@ bool TempDbKindConfigurator::CanCacheConfiguratorStatus(const std::string& confF
 	return false;
 }
 
+bool TempDbKindConfigurator::CachesPerBoot() const
+{
+	return true;
+}
+
@@ -19,6 +19,7 @@
 
 #include "db/MojDbClient.h"
 #include "Configurator.h"
+#include <tr1/unordered_map>
 
 class DbKindConfigurator : public Configurator
 {
@@ -32,10 +33,22 @@ protected:
 
 	virtual const char* ConfiguratorName() const;
 	virtual const char* ServiceName() const;
+	virtual size_t DefaultInFlightWindow() const;
 	MojErr CheckOwner(const std::string& filePath, MojObject &params, std::string &ownerid) const;
+	virtual void ConfigFound(const std::string& filePath);
+	virtual void ScanFinished();
+	virtual void ConfigDone(const std::string& filePath, bool success);
 
 private:
+	typedef std::tr1::unordered_map<PathTable::Handle, std::string> KindIdMap;
+
 	MojDbClient& m_dbClient;
+
+	// ids of the kinds being registered, by config file
+	KindIdMap m_kindIds;
+
+	// reused for every removal, serialized as it is sent
+	MojObject m_delKind;
 };
 
 class MediaDbKindConfigurator : public DbKindConfigurator
@@ -56,6 +69,7 @@ protected:
 	virtual const char* ServiceName() const;
 
 	virtual bool CanCacheConfiguratorStatus(const std::string& confFile) const;
+	virtual bool CachesPerBoot() const;
 };
 
 #endif /* DBKINDCONFIGURATOR_H_ */
@@ -24,6 +24,48 @@ static const char *MOJODB_DB_BUS_ADDRESS = "com.palm.db";
 static const char *MOJODB_TEMPDB_BUS_ADDRESS = "com.palm.tempdb";
 static const char *MOJODB_MEDIADB_BUS_ADDRESS = "com.webos.mediadb";
 static const char *MOJODB_PUTPERMISSIONS_METHOD = "putPermissions";
+static const size_t DBPERMISSIONS_INFLIGHT_WINDOW = 8;
+
+class DbPermissionsBatchResponse : public MojSignalHandler
+{
+public:
+	typedef MojServiceRequest::ReplySignal::Slot<DbPermissionsBatchResponse> BatchSlot;
+
+	DbPermissionsBatchResponse(DbPermissionsConfigurator *configurator, const std::string& owner, DbPermissionsConfigurator::BatchEntries& entries)
+		: m_slot(this, &DbPermissionsBatchResponse::Response),
+		  m_handler(configurator),
+		  m_owner(owner)
+	{
+		m_entries.swap(entries);
+	}
+
+	~DbPermissionsBatchResponse()
+	{
+	}
+
+	BatchSlot m_slot;
+
+private:
+	MojErr Response(MojObject& response, MojErr err)
+	{
+		MojErr result = MojErrNone;
+		try {
+			m_slot.cancel();
+			result = m_handler->BatchResponse(m_owner, m_entries, response, err);
+		} catch (const std::exception& e) {
+			MojErrThrowMsg(MojErrInternal, "%s", e.what());
+		} catch (...) {
+			MojErrThrowMsg(MojErrInternal, "Uncaught exception in DbPermissionsBatchResponse!");
+		}
+		return result;
+	}
+
+	MojRefCountedPtr<DbPermissionsConfigurator> m_handler;
+	const std::string m_owner;
+	DbPermissionsConfigurator::BatchEntries m_entries;
+
+	friend class DbPermissionsConfigurator;
+};
 
 const char* DbPermissionsConfigurator::ConfiguratorName() const
 {
@@ -35,9 +77,16 @@ const char* DbPermissionsConfigurator::ServiceName() const
 	 return MOJODB_DB_BUS_ADDRESS;
 }
 
+size_t DbPermissionsConfigurator::DefaultInFlightWindow() const
+{
+	return DBPERMISSIONS_INFLIGHT_WINDOW;
+}
+
 DbPermissionsConfigurator::DbPermissionsConfigurator(const std::string& id, ConfigType confType, RunType type, BusClient& busClient, MojDbClient& dbClient, string configDirectory)
 : Configurator(id, confType, type, busClient, configDirectory),
-  m_dbClient(dbClient)
+  m_dbClient(dbClient),
+  m_batchOperations(false),
+  m_perms(MojObject::TypeObject)
 {
 
 }
@@ -47,26 +96,153 @@ DbPermissionsConfigurator::~DbPermissionsConfigurator()
 
 }
 
+void DbPermissionsConfigurator::SetBatchOperations(bool batch)
+{
+	m_batchOperations = batch;
+}
+
 MojErr DbPermissionsConfigurator::ProcessConfig(const string& filePath, MojObject& permissions)
 {
 	LOG_TRACE("Entering function %s", __FUNCTION__);
 
-	std::string owner;
-	MojObject perms;
+	// permissions for a kind registered in this run have to wait for it
+	DependencyTracker::Resources kinds;
+	for (MojObject::ConstArrayIterator i = permissions.arrayBegin(); i != permissions.arrayEnd(); ++i) {
+		MojString type;
+		MojString object;
+		if (i->getRequired("type", type) == MojErrNone && type == "db.kind" &&
+		    i->getRequired("object", object) == MojErrNone)
+			kinds.push_back(object.data());
+	}
+	if (!m_busClient.GetDependencies().Ready(ServiceName(), kinds))
+		return MojErrWouldBlock;
+
+	const std::string& owner = ParentId(filePath);
+	if (m_batchOperations) {
+		// sent by FlushRequests() together with the other configs of this owner
+		BatchEntries& batch = m_batches[owner];
+		batch.push_back(BatchEntry());
+		batch.back().token = CurrentConfig();
+		batch.back().path = Paths().Intern(filePath);
+		batch.back().permissions.swap(permissions);
+		return MojErrNone;
+	}
 
-	owner = ParentId(filePath);
-    MojErr err = perms.put("permissions", permissions);
-    MojErrCheck(err);
+	return SendPermissions(CurrentConfig(), filePath, owner, permissions);
+}
 
+MojRefCountedPtr<MojServiceRequest> DbPermissionsConfigurator::CreateRequest(const std::string& owner)
+{
 	// for third-party packages, we set the appid on the service request
 	// so that mojodb does things correctly.  root config files aren't split up
 	// in a per-service/app directory way (though they should be like activitymanager)
-	MojRefCountedPtr<MojServiceRequest> request;
 	if (!owner.empty())
-		request = m_busClient.CreateRequest(owner.c_str());
-	else
-		request = m_busClient.CreateRequest();
-	return request->send(CreateCallback(filePath)->m_slot, ServiceName(), MOJODB_PUTPERMISSIONS_METHOD, perms);
+		return m_busClient.CreateRequest(owner.c_str());
+	return m_busClient.CreateRequest();
+}
+
+MojErr DbPermissionsConfigurator::SendPermissions(PendingToken token, const std::string& filePath, const std::string& owner, const MojObject& permissions)
+{
+	MojErr err = m_perms.put("permissions", permissions);
+	MojErrCheck(err);
+
+	// the callback reports back to the config it is created for
+	const PendingToken current = CurrentConfig();
+	SetCurrentConfig(token);
+	err = CreateRequest(owner)->send(CreateCallback(filePath)->m_slot, ServiceName(), MOJODB_PUTPERMISSIONS_METHOD, m_perms);
+	SetCurrentConfig(current);
+	return err;
+}
+
+void DbPermissionsConfigurator::FlushRequests()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	// responses may re-enter Run() and queue up the next batches
+	BatchMap batches;
+	batches.swap(m_batches);
+
+	for (BatchMap::iterator i = batches.begin(); i != batches.end(); ++i) {
+		BatchEntries& entries = i->second;
+		MojErr err;
+
+		if (entries.size() == 1)
+			err = SendPermissions(entries[0].token, Paths().Get(entries[0].path), i->first, entries[0].permissions);
+		else
+			err = SendBatch(i->first, entries);
+
+		if (err) {
+			// the files are still in the pending list - report them as failed
+			for (BatchEntries::iterator entry = entries.begin(); entry != entries.end(); ++entry) {
+				MojObject response;
+				ConfigResponse(entry->token, response, err);
+			}
+		}
+	}
+}
+
+MojErr DbPermissionsConfigurator::SendBatch(const std::string& owner, BatchEntries& entries)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+	MojErr err;
+
+	// putPermissions takes any number of them
+	MojObject permissions(MojObject::TypeArray);
+	for (BatchEntries::const_iterator entry = entries.begin(); entry != entries.end(); ++entry) {
+		for (MojObject::ConstArrayIterator i = entry->permissions.arrayBegin(); i != entry->permissions.arrayEnd(); ++i) {
+			err = permissions.push(*i);
+			MojErrCheck(err);
+		}
+	}
+	err = m_perms.put("permissions", permissions);
+	MojErrCheck(err);
+
+	LOG_DEBUG("%s :: putting the permissions of %zu configs for %s at once", ConfiguratorName(), entries.size(), owner.c_str());
+
+	// the response object takes over the entries
+	DbPermissionsBatchResponse *response = new DbPermissionsBatchResponse(this, owner, entries);
+	MojAllocCheck(response);
+	err = CreateRequest(owner)->send(response->m_slot, ServiceName(), MOJODB_PUTPERMISSIONS_METHOD, m_perms);
+	if (err)
+		entries.swap(response->m_entries);
+	return err;
+}
+
+MojErr DbPermissionsConfigurator::BatchResponse(const std::string& owner, BatchEntries& entries, MojObject& response, MojErr err)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	bool success = true;
+	response.get("returnValue", success);
+
+	if (err || !success) {
+		// rejected as a whole - there is no telling which config it was, so
+		// send them one at a time instead for the rest of this run
+		MojString json;
+		response.toJson(json);
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+				PMLOGKS("owner", owner.c_str()),
+				PMLOGKFV("error", "%d", err),
+				"Permissions of %zu configs for %s failed, sending individually: %s", entries.size(), owner.c_str(), json.data());
+		m_batchOperations = false;
+
+		for (BatchEntries::iterator entry = entries.begin(); entry != entries.end(); ++entry) {
+			// timed out meanwhile - already retried or counted as failed
+			if (!IsPending(entry->token))
+				continue;
+
+			MojErr sendErr = SendPermissions(entry->token, Paths().Get(entry->path), owner, entry->permissions);
+			if (sendErr) {
+				MojObject empty;
+				ConfigResponse(entry->token, empty, sendErr);
+			}
+		}
+		return MojErrNone;
+	}
+
+	for (BatchEntries::iterator entry = entries.begin(); entry != entries.end(); ++entry)
+		ConfigResponse(entry->token, response, MojErrNone);
+	return MojErrNone;
 }
 
 MojErr DbPermissionsConfigurator::ProcessConfigRemoval(const string& filePath, MojObject& params)
@@ -112,3 +288,8 @@ bool TempDbPermissionsConfigurator::CanCacheConfiguratorStatus(const std::string
 	return false;
 }
 
+bool TempDbPermissionsConfigurator::CachesPerBoot() const
+{
+	return true;
+}
+
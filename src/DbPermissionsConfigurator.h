@@ -19,6 +19,8 @@
 
 #include "db/MojDbClient.h"
 #include "Configurator.h"
+#include <map>
+#include <vector>
 
 class DbPermissionsConfigurator : public Configurator
 {
@@ -26,15 +28,46 @@ public:
 	DbPermissionsConfigurator(const std::string& id, ConfigType confType, RunType type, BusClient& busClient, MojDbClient& dbClient, std::string configDirectory);
 	virtual ~DbPermissionsConfigurator();
 
+	// put the permissions of the configs sharing an owner with a single
+	// putPermissions call
+	void SetBatchOperations(bool batch);
+
 protected:
 	virtual MojErr ProcessConfig(const std::string& filePath, MojObject& permission);
 	virtual MojErr ProcessConfigRemoval(const std::string &filePath, MojObject &json);
 
 	virtual const char* ConfiguratorName() const;
 	virtual const char* ServiceName() const;
+	virtual size_t DefaultInFlightWindow() const;
+	virtual void FlushRequests();
 
 private:
+	struct BatchEntry {
+		PendingToken token;
+		PathTable::Handle path;
+		MojObject permissions;
+	};
+	typedef std::vector<BatchEntry> BatchEntries;
+	typedef std::map<std::string, BatchEntries> BatchMap;
+
+	MojErr SendPermissions(PendingToken token, const std::string& filePath, const std::string& owner, const MojObject& permissions);
+	MojErr SendBatch(const std::string& owner, BatchEntries& entries);
+	MojErr BatchResponse(const std::string& owner, BatchEntries& entries, MojObject& response, MojErr err);
+	MojRefCountedPtr<MojServiceRequest> CreateRequest(const std::string& owner);
+
 	MojDbClient& m_dbClient;
+	bool m_batchOperations;
+
+	/**
+	 * Key = owner the permissions are put for ("" for the root configs)
+	 * Value = configs waiting to be sent in the next putPermissions
+	 */
+	BatchMap m_batches;
+
+	// {"permissions": [...]} - reused for every config, serialized as it is sent
+	MojObject m_perms;
+
+	friend class DbPermissionsBatchResponse;
 };
 
 class MediaDbPermissionsConfigurator : public DbPermissionsConfigurator
@@ -55,6 +88,7 @@ protected:
 	virtual const char* ServiceName() const;
 
 	virtual bool CanCacheConfiguratorStatus(const std::string& confFile) const;
+	virtual bool CachesPerBoot() const;
 };
 
 #endif /* DBPERMISSIONSCONFIGURATOR_H_ */
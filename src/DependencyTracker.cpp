@@ -0,0 +1,119 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "DependencyTracker.h"
+#include "Log.h"
+
+using namespace std;
+
+DependencyTracker::DependencyTracker()
+	: m_generation(0),
+	  m_waiting(false)
+{
+}
+
+DependencyTracker::~DependencyTracker()
+{
+}
+
+void DependencyTracker::AddProvider(const void* provider, const std::string& service)
+{
+	Provider& entry = m_providers[provider];
+	entry.service = service;
+	entry.announced = false;
+	entry.pending.clear();
+}
+
+void DependencyTracker::Providing(const void* provider, const std::string& resource)
+{
+	ProviderMap::iterator i = m_providers.find(provider);
+	if (i != m_providers.end())
+		i->second.pending.insert(resource);
+}
+
+bool DependencyTracker::Provided(const void* provider, const std::string& resource)
+{
+	ProviderMap::iterator i = m_providers.find(provider);
+	if (i == m_providers.end())
+		return false;
+
+	ResourceSet::iterator pending = i->second.pending.find(resource);
+	if (pending == i->second.pending.end())
+		return false;
+
+	i->second.pending.erase(pending);
+	return Changed();
+}
+
+bool DependencyTracker::Announced(const void* provider)
+{
+	ProviderMap::iterator i = m_providers.find(provider);
+	if (i == m_providers.end() || i->second.announced)
+		return false;
+
+	LOG_DEBUG("%s :: %zu resources still being provided", i->second.service.c_str(), i->second.pending.size());
+	i->second.announced = true;
+	return Changed();
+}
+
+bool DependencyTracker::Finished(const void* provider)
+{
+	// whatever it didn't get to won't be provided in this run
+	if (m_providers.erase(provider) == 0)
+		return false;
+	return Changed();
+}
+
+bool DependencyTracker::Ready(const std::string& service, const Resources& resources)
+{
+	for (ProviderMap::const_iterator i = m_providers.begin(); i != m_providers.end(); ++i) {
+		const Provider& provider = i->second;
+		if (provider.service != service)
+			continue;
+
+		// hasn't found all the resources it provides yet
+		if (!provider.announced) {
+			m_waiting = true;
+			return false;
+		}
+
+		for (Resources::const_iterator resource = resources.begin(); resource != resources.end(); ++resource) {
+			if (provider.pending.count(*resource)) {
+				m_waiting = true;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void DependencyTracker::Clear()
+{
+	m_providers.clear();
+	m_waiting = false;
+	m_generation++;
+}
+
+bool DependencyTracker::Changed()
+{
+	if (!m_waiting)
+		return false;
+
+	// the consumers turned down so far will ask again
+	m_waiting = false;
+	m_generation++;
+	return true;
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef DEPENDENCYTRACKER_H_
+#define DEPENDENCYTRACKER_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Orders configs of one run that depend on each other without serializing
+ * whole configurator types, e.g. the permissions for a db kind have to wait
+ * until the kind is registered with the same service.
+ *
+ * Providers (the db kind configurators) announce every resource they are
+ * going to register as they find it, and when it is done.  A consumer is
+ * ready once every provider of its service has announced all of its
+ * resources and none of the ones it needs is still being registered -
+ * resources nobody in the run provides are assumed to exist already.
+ */
+class DependencyTracker
+{
+public:
+	typedef std::vector<std::string> Resources;
+
+	DependencyTracker();
+	~DependencyTracker();
+
+	void AddProvider(const void* provider, const std::string& service);
+	void Providing(const void* provider, const std::string& resource);
+
+	// the methods below return whether a consumer that was turned down may
+	// be ready now (and should be given another chance)
+	bool Provided(const void* provider, const std::string& resource);
+	bool Announced(const void* provider);
+	bool Finished(const void* provider);
+
+	bool Ready(const std::string& service, const Resources& resources);
+
+	// changes whenever a turned down consumer may have become ready
+	unsigned Generation() const { return m_generation; }
+
+	void Clear();
+
+private:
+	typedef std::multiset<std::string> ResourceSet;
+
+	struct Provider {
+		std::string service;
+		bool announced;
+		ResourceSet pending;
+	};
+	typedef std::map<const void*, Provider> ProviderMap;
+
+	bool Changed();
+
+	ProviderMap m_providers;
+	unsigned m_generation;
+	bool m_waiting;
+};
+
+#endif /* DEPENDENCYTRACKER_H_ */
@@ -0,0 +1,183 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "DirScanner.h"
+#include "Log.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <map>
+
+using namespace std;
+
+bool DirScanner::Scan(const std::string& directory, Entries& entries, Directories* directories)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1) {
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 1,
+				PMLOGKS("directory", directory.c_str()),
+				"Failed to open directory: %s", directory.c_str());
+		return false;
+	}
+
+	ScanAt(fd, "", directory, entries, directories);
+	return true;
+}
+
+unsigned DirScanner::FindSubdirs(const std::string& directory, const char* const subdirs[], size_t count)
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return 0;
+	DIR* dp = fdopendir(fd);
+	if (dp == NULL) {
+		close(fd);
+		return 0;
+	}
+
+	Names names;
+	ReadDirectories(dp, names);
+
+	// e.g. db/kinds and db/permissions share db
+	typedef std::map<std::string, Names> NestedNames;
+	NestedNames nested;
+
+	unsigned found = 0;
+	for (size_t i = 0; i < count; i++) {
+		const std::string subdir(subdirs[i]);
+		const size_t slash = subdir.find('/');
+		if (slash == std::string::npos) {
+			if (names.count(subdir))
+				found |= 1u << i;
+			continue;
+		}
+
+		const std::string first = subdir.substr(0, slash);
+		if (!names.count(first))
+			continue;
+
+		NestedNames::iterator below = nested.find(first);
+		if (below == nested.end()) {
+			below = nested.insert(std::make_pair(first, Names())).first;
+			int subdirFd = openat(dirfd(dp), first.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			DIR* subdirDp = subdirFd == -1 ? NULL : fdopendir(subdirFd);
+			if (subdirDp) {
+				ReadDirectories(subdirDp, below->second);
+				closedir(subdirDp);
+			} else if (subdirFd != -1) {
+				close(subdirFd);
+			}
+		}
+		if (below->second.count(subdir.substr(slash + 1)))
+			found |= 1u << i;
+	}
+	closedir(dp);
+	return found;
+}
+
+void DirScanner::ReadDirectories(DIR* dp, Names& names)
+{
+	struct dirent* dirp;
+	while ((dirp = readdir(dp)) != NULL) {
+		const char *name = dirp->d_name;
+		if (name[0] == '.')
+			continue;
+
+		if (dirp->d_type == DT_DIR) {
+			names.insert(name);
+		} else if (dirp->d_type == DT_UNKNOWN || dirp->d_type == DT_LNK) {
+			struct stat stat_buf;
+			if (fstatat(dirfd(dp), name, &stat_buf, 0) == 0 && S_ISDIR(stat_buf.st_mode))
+				names.insert(name);
+		}
+	}
+}
+
+// takes ownership of dirFd
+void DirScanner::ScanAt(int dirFd, const std::string& parent, const std::string& directory, Entries& entries, Directories* directories)
+{
+	DIR* dp = fdopendir(dirFd);
+	if (dp == NULL) {
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+				PMLOGKS("directory", directory.c_str()),
+				PMLOGKS("error", strerror(errno)),
+				"Failed to read directory: %s (%s)", directory.c_str(), strerror(errno));
+		close(dirFd);
+		return;
+	}
+
+	LOG_DEBUG("Reading config files in '%s' under '%s'", directory.c_str(), parent.c_str());
+	if (directories)
+		directories->push_back(directory);
+
+	const std::string prefix = directory + "/";
+	struct dirent* dirp;
+
+	while ((dirp = readdir(dp)) != NULL) {
+		const char *name = dirp->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			continue;
+
+		bool isDir;
+		switch (dirp->d_type) {
+		case DT_DIR:
+			isDir = true;
+			break;
+		case DT_REG:
+			isDir = false;
+			break;
+		default: {
+			// unknown type or a symlink - find out what it points to
+			struct stat stat_buf;
+			if (fstatat(dirfd(dp), name, &stat_buf, 0) != 0) {
+				LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+						PMLOGKS("file", name),
+						PMLOGKS("directory", directory.c_str()),
+						"Failed to get file information on: %s in %s - skipping", name, directory.c_str());
+				continue;
+			}
+			isDir = S_ISDIR(stat_buf.st_mode);
+			break;
+		}
+		}
+
+		if (isDir) {
+			int subdirFd = openat(dirfd(dp), name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (subdirFd == -1) {
+				LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+						PMLOGKS("directory", name),
+						PMLOGKS("parent", directory.c_str()),
+						"Failed to open directory: %s, under %s - skipping", name, directory.c_str());
+				continue;
+			}
+			ScanAt(subdirFd, name, prefix + name, entries, directories);
+		} else {
+			entries.push_back(Entry());
+			Entry& entry = entries.back();
+			entry.path.reserve(prefix.length() + strlen(name));
+			entry.path.append(prefix).append(name);
+			entry.parent = parent;
+		}
+	}
+	closedir(dp);
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef DIRSCANNER_H_
+#define DIRSCANNER_H_
+
+#include <dirent.h>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Collects the config files below a configuration directory.
+ *
+ * The walk works relative to directory file descriptors (openat/fstatat)
+ * and trusts the entry type reported by readdir, so an entry is only
+ * stat'ed when the file system doesn't report its type.  Entries that
+ * can't be read are skipped.  It doesn't touch any configurator state so
+ * it is safe to run off the main loop.
+ */
+class DirScanner
+{
+public:
+	struct Entry {
+		std::string path;   // full path to the config file
+		std::string parent; // name of the directory containing it ("" at the top level)
+	};
+	typedef std::vector<Entry> Entries;
+	typedef std::vector<std::string> Directories;
+
+	// returns whether the directory exists; directories (if given) receives
+	// every directory walked, starting with directory itself
+	static bool Scan(const std::string& directory, Entries& entries, Directories* directories = NULL);
+
+	// which of subdirs (relative to directory, at most two levels deep)
+	// exist - bit i is set for subdirs[i].  Reads directory, and the first
+	// level below it that is shared by several of them, only once.
+	static unsigned FindSubdirs(const std::string& directory, const char* const subdirs[], size_t count);
+
+private:
+	typedef std::set<std::string> Names;
+
+	static void ReadDirectories(DIR* dp, Names& names);
+	static void ScanAt(int dirFd, const std::string& parent, const std::string& directory, Entries& entries, Directories* directories);
+};
+
+#endif /* DIRSCANNER_H_ */
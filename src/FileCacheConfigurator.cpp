@@ -24,6 +24,7 @@ const char* const FileCacheConfigurator::FILECACHE_BUS_ADDRESS		 = "com.palm.fil
 const char* const FileCacheConfigurator::FILECACHE_DEFINETYPE_METHOD = "DefineType";
 const char* const FileCacheConfigurator::FILECACHE_DELETETYPE_METHOD = "DeleteType";
 const char* const FileCacheConfigurator::FILECACHE_TYPENAME_KEY = "typeName";
+const size_t FileCacheConfigurator::FILECACHE_INFLIGHT_WINDOW = 4;
 
 static bool endsWith(const std::string& str, const std::string &suffix)
 {
@@ -86,7 +87,7 @@ public:
 					errorText = mojErrorText.data();
 
 					if (endsWith(errorText, nakOkSuffix)) {
-						LOG_DEBUG("caching negative response for %s", m_config.c_str());
+						LOG_DEBUG("caching negative response for %s", ConfigPath().c_str());
 						bool found = false;
 						response.del("errorCode", found);
 						response.del("errorText", found);
@@ -107,7 +108,7 @@ public:
 				LOG_WARNING(MSGID_FILE_CACHE_CONFIG_WARNING, 0, "errorCode not provided in request failure");
 			}
 		} else {
-			LOG_DEBUG("FileCacheConfigurator response for %s contained no problems", m_config.c_str());
+			LOG_DEBUG("FileCacheConfigurator response for %s contained no problems", ConfigPath().c_str());
 		}
 		return DelegateResponse(response, err);
 	}
@@ -123,8 +124,14 @@ const char* FileCacheConfigurator::ServiceName() const
 	 return FILECACHE_BUS_ADDRESS;
 }
 
+size_t FileCacheConfigurator::DefaultInFlightWindow() const
+{
+	return FILECACHE_INFLIGHT_WINDOW;
+}
+
 FileCacheConfigurator::FileCacheConfigurator(const std::string& id, ConfigType confType, RunType type, BusClient& busClient, string configDirectory)
-: Configurator(id, confType, type, busClient, configDirectory)
+: Configurator(id, confType, type, busClient, configDirectory),
+  m_removal(MojObject::TypeObject)
 {
 
 }
@@ -154,8 +161,7 @@ MojErr FileCacheConfigurator::ProcessConfigRemoval(const string& filePath, MojOb
 	MojString typeName;
 	err = params.getRequired(FILECACHE_TYPENAME_KEY, typeName); MojErrCheck(err);
 
-	MojObject request(MojObject::TypeObject);
-	err = request.putString(FILECACHE_TYPENAME_KEY, typeName); 	MojErrCheck(err);
+	err = m_removal.putString(FILECACHE_TYPENAME_KEY, typeName); 	MojErrCheck(err);
 
-	return m_busClient.CreateRequest()->send(CreateCallback(filePath)->m_slot, ServiceName(), FILECACHE_DELETETYPE_METHOD, request);
+	return m_busClient.CreateRequest()->send(CreateCallback(filePath)->m_slot, ServiceName(), FILECACHE_DELETETYPE_METHOD, m_removal);
 }
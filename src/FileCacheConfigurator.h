@@ -32,12 +32,17 @@ protected:
 	virtual ConfiguratorCallback* CreateCallback(const std::string& filePath);
 	virtual const char* ConfiguratorName() const;
 	virtual const char* ServiceName() const;
+	virtual size_t DefaultInFlightWindow() const;
 
 private:
 	static const char* const FILECACHE_BUS_ADDRESS;
 	static const char* const FILECACHE_DEFINETYPE_METHOD;
 	static const char* const FILECACHE_DELETETYPE_METHOD;
 	static const char* const FILECACHE_TYPENAME_KEY;
+	static const size_t FILECACHE_INFLIGHT_WINDOW;
+
+	// reused for every removal, serialized as it is sent
+	MojObject m_removal;
 };
 
 #endif /* FILECACHECONFIGURATOR_H_ */
@@ -0,0 +1,187 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "FirstUseIndex.h"
+#include "Log.h"
+#include "MappedFile.h"
+#include "StampIndex.h"
+#include <errno.h>
+#include <string.h>
+
+using namespace std;
+
+const char* const FirstUseIndex::INDEX_FILE     = ".first-use-index";
+const char        FirstUseIndex::INDEX_MAGIC[8] = { 'C', 'F', 'G', 'F', 'U', 'S', 'E', 'X' };
+const uint32_t    FirstUseIndex::INDEX_VERSION  = 1;
+
+/*
+ * On-disk layout (host byte order, like the stamp index):
+ *
+ *   header: magic[8] version:u32 count:u32 bootId[40]
+ *   entry:  mtime:i64 size:i64 mtimeNsec:u32 states:u32 pathLength:u32 path[pathLength]
+ */
+struct FirstUseHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t count;
+	char     bootId[40];
+};
+
+struct FirstUseEntry {
+	int64_t  mtime;
+	int64_t  size;
+	uint32_t mtimeNsec;
+	uint32_t states;
+	uint32_t pathLength;
+};
+
+FirstUseIndex::FirstUseIndex(const std::string& cacheDir)
+	: m_indexPath(cacheDir + INDEX_FILE),
+	  m_dirty(false)
+{
+}
+
+FirstUseIndex::~FirstUseIndex()
+{
+}
+
+void FirstUseIndex::Load()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	m_entries.clear();
+	m_dirty = false;
+	m_bootId = StampIndex::BootId();
+
+	MappedFile file;
+	if (!file.Open(m_indexPath, MappedFile::MapLarge)) {
+		if (errno != ENOENT) {
+			LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+					PMLOGKS("index", m_indexPath.c_str()),
+					PMLOGKS("error", strerror(errno)),
+					"Failed to read first use index %s: %s", m_indexPath.c_str(), strerror(errno));
+		}
+		return;
+	}
+
+	const char *pos = file.Data();
+	const char *end = pos + file.Length();
+	FirstUseHeader header;
+	if (file.Length() < sizeof(header))
+		return;
+	memcpy(&header, pos, sizeof(header));
+	pos += sizeof(header);
+
+	if (memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.version != INDEX_VERSION)
+		return;
+
+	// recorded during an earlier boot - nothing in it holds any more
+	if (m_bootId.empty() || strncmp(header.bootId, m_bootId.c_str(), sizeof(header.bootId)) != 0) {
+		LOG_DEBUG("First use index %s is from another boot", m_indexPath.c_str());
+		m_dirty = true;
+		return;
+	}
+
+	for (uint32_t i = 0; i < header.count; i++) {
+		FirstUseEntry entry;
+		if ((size_t)(end - pos) < sizeof(entry))
+			break;
+		memcpy(&entry, pos, sizeof(entry));
+		pos += sizeof(entry);
+		if ((size_t)(end - pos) < entry.pathLength)
+			break;
+
+		Entry& loaded = m_entries[std::string(pos, entry.pathLength)];
+		loaded.mtime = entry.mtime;
+		loaded.mtimeNsec = entry.mtimeNsec;
+		loaded.size = entry.size;
+		loaded.states = entry.states;
+		pos += entry.pathLength;
+	}
+	LOG_DEBUG("Loaded %zu activities from %s", m_entries.size(), m_indexPath.c_str());
+}
+
+bool FirstUseIndex::Save()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	if (!m_dirty)
+		return true;
+
+	std::string buffer;
+	FirstUseHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version = INDEX_VERSION;
+	header.count = m_entries.size();
+	strncpy(header.bootId, m_bootId.c_str(), sizeof(header.bootId) - 1);
+	buffer.append(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	for (EntryMap::const_iterator i = m_entries.begin(); i != m_entries.end(); ++i) {
+		FirstUseEntry entry;
+		entry.mtime = i->second.mtime;
+		entry.mtimeNsec = i->second.mtimeNsec;
+		entry.size = i->second.size;
+		entry.states = i->second.states;
+		entry.pathLength = i->first.length();
+		buffer.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+		buffer.append(i->first);
+	}
+
+	if (!MappedFile::WriteAtomically(m_indexPath, buffer.data(), buffer.length()))
+		return false;
+
+	m_dirty = false;
+	LOG_DEBUG("Saved %zu activities to %s", m_entries.size(), m_indexPath.c_str());
+	return true;
+}
+
+unsigned FirstUseIndex::Lookup(const std::string& confFile) const
+{
+	EntryMap::const_iterator i = m_entries.find(confFile);
+	if (i == m_entries.end())
+		return Unknown;
+
+	struct stat info;
+	if (stat(confFile.c_str(), &info) != 0 ||
+	    i->second.mtime != (int64_t) info.st_mtim.tv_sec ||
+	    i->second.mtimeNsec != (uint32_t) info.st_mtim.tv_nsec ||
+	    i->second.size != (int64_t) info.st_size)
+		return Unknown;
+
+	return i->second.states;
+}
+
+void FirstUseIndex::Record(const std::string& confFile, State state)
+{
+	// without a boot to tie it to it would never be trusted again
+	if (m_bootId.empty())
+		return;
+
+	struct stat info;
+	if (stat(confFile.c_str(), &info) != 0)
+		return;
+
+	const bool current = Lookup(confFile) != Unknown;
+	Entry& entry = m_entries[confFile];
+	if (!current)
+		entry.states = 0;
+	entry.mtime = info.st_mtim.tv_sec;
+	entry.mtimeNsec = info.st_mtim.tv_nsec;
+	entry.size = info.st_size;
+	entry.states |= state;
+	m_dirty = true;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef FIRSTUSEINDEX_H_
+#define FIRSTUSEINDEX_H_
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <tr1/unordered_map>
+#include <string>
+
+/**
+ * What the activity configurator learned about its configs during the
+ * current boot: which ones are held back until first use has completed.
+ *
+ * Until first use is done every trigger of the configurator would read and
+ * parse all the activities again just to find the same ones not safe yet.
+ * The ones created already are left to the per-boot stamps (bootCache).
+ *
+ * The entries are only valid for the boot they were recorded in and for
+ * the file contents they were recorded for - anything else is looked at
+ * again.
+ */
+class FirstUseIndex
+{
+public:
+	enum State {
+		Unknown  = 0,
+		Deferred = 1 << 0, // not safe to create before first use
+	};
+
+	FirstUseIndex(const std::string& cacheDir);
+	~FirstUseIndex();
+
+	void Load();
+	bool Save();
+
+	// Unknown unless recorded for the current contents of confFile
+	unsigned Lookup(const std::string& confFile) const;
+	void     Record(const std::string& confFile, State state);
+
+private:
+	struct Entry {
+		int64_t  mtime;
+		uint32_t mtimeNsec;
+		int64_t  size;
+		unsigned states;
+	};
+	typedef std::tr1::unordered_map<std::string, Entry> EntryMap;
+
+	static const char* const INDEX_FILE;
+	static const char        INDEX_MAGIC[8];
+	static const uint32_t    INDEX_VERSION;
+
+	const std::string m_indexPath;
+	std::string m_bootId;
+	EntryMap m_entries;
+	bool m_dirty;
+};
+
+#endif /* FIRSTUSEINDEX_H_ */
@@ -58,6 +58,7 @@ PMLOG_TRACE(__VA_ARGS__);
 #define MSGID_CONFIGURATOR_WARNING          "CONFIGURATOR_WARNING"
 #define MSGID_CONFIGURATOR_ERROR            "CONFIGURATOR_ERROR"
 #define MSGID_SHUTDOWN_ERROR                "SHUTDOWN_ERROR"
+#define MSGID_CONFIGURATOR_STATS            "CONFIGURATOR_STATS"
 
 extern PmLogContext getConfiguratorLogContext();
 
@@ -0,0 +1,147 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "MappedFile.h"
+#include "Log.h"
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const size_t MappedFile::MAP_THRESHOLD = 16 * 1024;
+
+MappedFile::MappedFile()
+	: m_data(NULL),
+	  m_length(0),
+	  m_mapped(false)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+void MappedFile::Close()
+{
+	if (m_mapped)
+		munmap(const_cast<char *>(m_data), m_length);
+	m_data = NULL;
+	m_length = 0;
+	m_mapped = false;
+	m_buffer.clear();
+}
+
+bool MappedFile::Open(const std::string& filePath, Mode mode)
+{
+	Close();
+
+	int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+	if (fd == -1 && errno == EPERM) // O_NOATIME needs ownership of the file
+		fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) == -1) {
+		close(fd);
+		return false;
+	}
+
+	const size_t length = info.st_size;
+	bool ok = true;
+
+	if (length == 0) {
+		m_data = m_buffer.data();
+	} else if (mode == MapLarge && length >= MAP_THRESHOLD) {
+		void *mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			ok = false;
+		} else {
+			m_data = static_cast<const char *>(mapped);
+			m_length = length;
+			m_mapped = true;
+		}
+	} else {
+		m_buffer.resize(length);
+		ssize_t got;
+		do {
+			got = pread(fd, &m_buffer[0], length, 0);
+		} while (got == -1 && errno == EINTR);
+
+		if (got < 0) {
+			ok = false;
+			m_buffer.clear();
+		} else {
+			// the file may have shrunk since fstat()
+			m_buffer.resize(got);
+			m_data = m_buffer.data();
+			m_length = got;
+		}
+	}
+
+	close(fd);
+	return ok;
+}
+
+bool MappedFile::WriteAtomically(const std::string& filePath, const char* data, size_t length)
+{
+	// write to the side and rename over the original
+	const std::string tmpPath = filePath + ".tmp";
+	int fd = open(tmpPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd == -1) {
+		LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 2,
+				PMLOGKS("file", tmpPath.c_str()),
+				PMLOGKS("error", strerror(errno)),
+				"Failed to write %s: %s", tmpPath.c_str(), strerror(errno));
+		return false;
+	}
+
+	size_t remaining = length;
+	while (remaining > 0) {
+		ssize_t written = write(fd, data, remaining);
+		if (written == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		data += written;
+		remaining -= written;
+	}
+
+	if (remaining > 0 || fsync(fd) == -1) {
+		LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 2,
+				PMLOGKS("file", tmpPath.c_str()),
+				PMLOGKS("error", strerror(errno)),
+				"Failed to write %s: %s", tmpPath.c_str(), strerror(errno));
+		close(fd);
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	close(fd);
+
+	if (rename(tmpPath.c_str(), filePath.c_str()) == -1) {
+		LOG_ERROR(MSGID_CONFIGURATOR_ERROR, 2,
+				PMLOGKS("file", filePath.c_str()),
+				PMLOGKS("error", strerror(errno)),
+				"Failed to replace %s: %s", filePath.c_str(), strerror(errno));
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <stddef.h>
+#include <string>
+
+/**
+ * Read-only view of a whole file, read with a single pread().  With
+ * MapLarge large files are mapped instead (mapping costs more than copying
+ * a few pages) - only for the files the configurator replaces as a whole
+ * itself: touching the mapping of a file someone truncated meanwhile (a
+ * package being reinstalled) raises SIGBUS.
+ * The contents are not NUL terminated.
+ */
+class MappedFile
+{
+public:
+	enum Mode {
+		Copy,
+		MapLarge,
+	};
+
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string& filePath, Mode mode = Copy);
+	void Close();
+
+	const char* Data() const { return m_data; }
+	size_t      Length() const { return m_length; }
+
+	// replaces filePath with data so that readers see either the old or the
+	// new contents in full, even across a crash
+	static bool WriteAtomically(const std::string& filePath, const char* data, size_t length);
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	static const size_t MAP_THRESHOLD;
+
+	const char *m_data;
+	size_t m_length;
+	bool m_mapped;
+	std::string m_buffer;
+};
+
+#endif /* MAPPEDFILE_H_ */
@@ -0,0 +1,85 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "PathTable.h"
+#include "StampIndex.h"
+
+const PathTable::Handle PathTable::NoHandle = (PathTable::Handle) -1;
+const size_t PathTable::INITIAL_BUCKETS = 256;
+
+PathTable::PathTable()
+	: m_buckets(INITIAL_BUCKETS, NoHandle),
+	  m_generation(0)
+{
+}
+
+PathTable::~PathTable()
+{
+}
+
+size_t PathTable::Lookup(const std::string& path) const
+{
+	// the bucket holding path, or the free one it would go to
+	const size_t mask = m_buckets.size() - 1;
+	size_t bucket = StampIndex::Hash(path.data(), path.length()) & mask;
+	while (m_buckets[bucket] != NoHandle && m_strings[m_buckets[bucket]] != path)
+		bucket = (bucket + 1) & mask;
+	return bucket;
+}
+
+PathTable::Handle PathTable::Intern(const std::string& path)
+{
+	size_t bucket = Lookup(path);
+	if (m_buckets[bucket] != NoHandle)
+		return m_buckets[bucket];
+
+	const Handle handle = m_strings.size();
+	m_strings.push_back(path);
+	m_buckets[bucket] = handle;
+
+	// keep the load below 3/4
+	if (m_strings.size() * 4 > m_buckets.size() * 3)
+		Grow();
+	return handle;
+}
+
+PathTable::Handle PathTable::Find(const std::string& path) const
+{
+	return m_buckets[Lookup(path)];
+}
+
+const std::string& PathTable::Get(Handle handle) const
+{
+	static const std::string empty;
+	if (handle >= m_strings.size())
+		return empty;
+	return m_strings[handle];
+}
+
+void PathTable::Grow()
+{
+	std::vector<Handle> buckets(m_buckets.size() * 2, NoHandle);
+	m_buckets.swap(buckets);
+	for (Handle handle = 0; handle < m_strings.size(); handle++)
+		m_buckets[Lookup(m_strings[handle])] = handle;
+}
+
+void PathTable::Clear()
+{
+	m_strings.clear();
+	std::vector<Handle>(INITIAL_BUCKETS, NoHandle).swap(m_buckets);
+	m_generation++;
+}
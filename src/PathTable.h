@@ -0,0 +1,71 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef PATHTABLE_H_
+#define PATHTABLE_H_
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * Interns the config paths (and parent directory names) of a run, so each
+ * one is stored once and the configurators pass around 32-bit handles
+ * instead of copies.
+ *
+ * Strings never move once interned - references returned by Get() and
+ * Intern() stay valid until Clear(), which the bus client only calls
+ * between runs once no reply of an earlier run is outstanding.  Handles
+ * kept across a run check Generation(), which every Clear() changes.
+ * Only used from the main loop.
+ */
+class PathTable
+{
+public:
+	typedef uint32_t Handle;
+	static const Handle NoHandle;
+
+	PathTable();
+	~PathTable();
+
+	Handle Intern(const std::string& path);
+
+	// NoHandle if path has not been interned
+	Handle Find(const std::string& path) const;
+
+	// the empty string for NoHandle
+	const std::string& Get(Handle handle) const;
+
+	size_t   Size() const { return m_strings.size(); }
+	unsigned Generation() const { return m_generation; }
+	void     Clear();
+
+private:
+	static const size_t INITIAL_BUCKETS;
+
+	size_t Lookup(const std::string& path) const;
+	void   Grow();
+
+	std::deque<std::string> m_strings;
+
+	// open addressing over the handles, NoHandle marks a free bucket
+	std::vector<Handle> m_buckets;
+
+	unsigned m_generation;
+};
+
+#endif /* PATHTABLE_H_ */
@@ -0,0 +1,136 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ServiceLimiter.h"
+#include "Log.h"
+
+const double ServiceLimiter::INITIAL_LIMIT     = 4;
+const size_t ServiceLimiter::MINIMUM_LIMIT     = 1;
+const size_t ServiceLimiter::DEFAULT_MAXIMUM   = 32;
+const gint64 ServiceLimiter::LATENCY_TOLERANCE = 4;    // times the fastest reply
+const gint64 ServiceLimiter::LATENCY_FLOOR_US  = 5000; // never back off below this
+
+ServiceLimiter::Limit::Limit()
+	: limit(INITIAL_LIMIT),
+	  maximum(DEFAULT_MAXIMUM),
+	  inFlight(0),
+	  slowStart(true),
+	  waiting(false),
+	  fastest(0),
+	  hold(0),
+	  backoffs(0),
+	  failures(0)
+{
+}
+
+ServiceLimiter::ServiceLimiter()
+{
+}
+
+ServiceLimiter::~ServiceLimiter()
+{
+}
+
+ServiceLimiter::Limit& ServiceLimiter::Lookup(const std::string& service)
+{
+	return m_limits[service];
+}
+
+void ServiceLimiter::SetMaximum(const std::string& service, size_t maximum)
+{
+	Limit& limit = Lookup(service);
+	limit.maximum = maximum ? maximum : DEFAULT_MAXIMUM;
+	if (limit.limit > limit.maximum)
+		limit.limit = limit.maximum;
+}
+
+bool ServiceLimiter::Acquire(const char* service)
+{
+	Limit& limit = Lookup(service);
+	if (limit.inFlight >= (size_t) limit.limit) {
+		limit.waiting = true;
+		return false;
+	}
+	limit.inFlight++;
+	return true;
+}
+
+void ServiceLimiter::Cancel(const char* service)
+{
+	Limit& limit = Lookup(service);
+	if (limit.inFlight > 0)
+		limit.inFlight--;
+}
+
+bool ServiceLimiter::Release(const char* service, gint64 latency, bool failed)
+{
+	Limit& limit = Lookup(service);
+	if (limit.inFlight > 0)
+		limit.inFlight--;
+
+	if (failed)
+		limit.failures++;
+	if (!failed && (limit.fastest == 0 || latency < limit.fastest))
+		limit.fastest = latency;
+
+	const bool slow = latency > LATENCY_FLOOR_US && latency > limit.fastest * LATENCY_TOLERANCE;
+	if (limit.hold > 0) {
+		// sent before the last back off
+		limit.hold--;
+	} else if (failed || slow) {
+		limit.limit = limit.limit / 2 < MINIMUM_LIMIT ? MINIMUM_LIMIT : limit.limit / 2;
+		limit.slowStart = false;
+		limit.hold = limit.inFlight;
+		limit.backoffs++;
+		LOG_DEBUG("%s is struggling (%s, %" G_GINT64_FORMAT " us) - limit down to %.0f",
+				service, failed ? "failed" : "slow", latency, limit.limit);
+	} else if (limit.slowStart) {
+		limit.limit += 1;
+	} else {
+		limit.limit += 1 / limit.limit;
+	}
+	if (limit.limit > limit.maximum)
+		limit.limit = limit.maximum;
+
+	bool wake = limit.waiting && limit.inFlight < (size_t) limit.limit;
+	if (wake)
+		limit.waiting = false;
+	return wake;
+}
+
+MojErr ServiceLimiter::ToJson(MojObject& limits) const
+{
+	MojErr err;
+	for (LimitMap::const_iterator i = m_limits.begin(); i != m_limits.end(); ++i) {
+		const Limit& limit = i->second;
+		MojObject entry;
+		err = entry.putInt("limit", (MojInt64) limit.limit);
+		MojErrCheck(err);
+		err = entry.putInt("maximum", limit.maximum);
+		MojErrCheck(err);
+		err = entry.putInt("inFlight", limit.inFlight);
+		MojErrCheck(err);
+		err = entry.putInt("fastestUs", limit.fastest);
+		MojErrCheck(err);
+		err = entry.putInt("backoffs", limit.backoffs);
+		MojErrCheck(err);
+		err = entry.putInt("failures", limit.failures);
+		MojErrCheck(err);
+		err = limits.put(i->first.c_str(), entry);
+		MojErrCheck(err);
+	}
+	return MojErrNone;
+}
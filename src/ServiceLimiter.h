@@ -0,0 +1,87 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef SERVICELIMITER_H_
+#define SERVICELIMITER_H_
+
+#include "core/MojObject.h"
+#include <glib.h>
+#include <map>
+#include <string>
+
+/**
+ * Limits the configs in flight per target service, shared by every
+ * configurator talking to it (the db kind and permission configurators
+ * all end up at the same db8 instance), on top of the in-flight window of
+ * each configurator.
+ *
+ * The limit adapts to how the service copes: it doubles while replies
+ * come back quickly (slow start), then grows by one per limit's worth of
+ * fast replies.  A failed reply, or one that took much longer than the
+ * fastest seen so far, halves it - at most once per limit's worth of
+ * replies, so a burst of slow replies to requests sent before the cut
+ * doesn't shrink it any further.  Only used from the main loop.
+ */
+class ServiceLimiter
+{
+public:
+	ServiceLimiter();
+	~ServiceLimiter();
+
+	// upper bound of the limit for service (0 restores the default)
+	void SetMaximum(const std::string& service, size_t maximum);
+
+	// whether another config may be sent to service - once refused, the
+	// next Release() for the service asks for a wake up
+	bool Acquire(const char* service);
+
+	// the config was not sent after all
+	void Cancel(const char* service);
+
+	// the reply for a config came back - returns whether a configurator
+	// was refused meanwhile and should be given another chance
+	bool Release(const char* service, gint64 latency, bool failed);
+
+	MojErr ToJson(MojObject& limits) const;
+
+private:
+	struct Limit {
+		Limit();
+
+		double limit;
+		size_t maximum;
+		size_t inFlight;
+		bool   slowStart;
+		bool   waiting;
+		gint64 fastest;    // latency of the fastest reply seen
+		size_t hold;       // replies to ignore after backing off
+		size_t backoffs;
+		size_t failures;
+	};
+	typedef std::map<std::string, Limit> LimitMap;
+
+	static const double INITIAL_LIMIT;
+	static const size_t MINIMUM_LIMIT;
+	static const size_t DEFAULT_MAXIMUM;
+	static const gint64 LATENCY_TOLERANCE;
+	static const gint64 LATENCY_FLOOR_US;
+
+	Limit& Lookup(const std::string& service);
+
+	LimitMap m_limits;
+};
+
+#endif /* SERVICELIMITER_H_ */
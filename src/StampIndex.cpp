@@ -0,0 +1,556 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "StampIndex.h"
+#include "Log.h"
+#include "MappedFile.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char* const StampIndex::INDEX_FILE    = ".stamp-index";
+const char        StampIndex::INDEX_MAGIC[8] = { 'C', 'F', 'G', 'S', 'T', 'A', 'M', 'P' };
+const uint32_t    StampIndex::INDEX_VERSION = 1;
+const uint32_t    StampIndex::SESSION_INDEX_VERSION = 2;
+const char* const StampIndex::JOURNAL_SUFFIX = ".journal";
+const char        StampIndex::JOURNAL_MAGIC[8] = { 'C', 'F', 'G', 'J', 'R', 'N', 'A', 'L' };
+const uint32_t    StampIndex::JOURNAL_VERSION = 1;
+
+/*
+ * On-disk layout (host byte order, the index never leaves the device):
+ *
+ *   header:  magic[8] version:u32 count:u32
+ *   session: sessionLength:u32 session[sessionLength] (version 2 only)
+ *   entry:   mtime:i64 size:i64 hash:u64 mtimeNsec:u32 pathLength:u32 path[pathLength]
+ */
+struct IndexHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t count;
+};
+
+struct IndexEntry {
+	int64_t  mtime;
+	int64_t  size;
+	uint64_t hash;
+	uint32_t mtimeNsec;
+	uint32_t pathLength;
+};
+
+/*
+ * Journal layout (appended to, one record per write):
+ *
+ *   header: magic[8] version:u32 sessionLength:u32 session[sessionLength]
+ *   record: op:u32 entry path[pathLength]
+ *
+ * A record cut short by a crash ends the journal.
+ */
+struct JournalHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t sessionLength;
+};
+
+static std::string Replace(std::string input, const std::string& substr, const std::string& replacement)
+{
+	size_t i;
+	size_t l;
+
+	i = input.find(substr);
+	l = substr.length();
+	while (i != string::npos) {
+		input.replace(i, l, replacement);
+		i = input.find(substr, i + l);
+	}
+
+	return input;
+}
+
+StampIndex::StampIndex(const std::string& cacheDir)
+	: m_cacheDir(cacheDir),
+	  m_indexPath(cacheDir + INDEX_FILE),
+	  m_journalPath(m_indexPath + JOURNAL_SUFFIX),
+	  m_dirty(false),
+	  m_journalFd(-1),
+	  m_journalStale(false),
+	  m_journalFailed(false)
+{
+}
+
+StampIndex::StampIndex(const std::string& cacheDir, const char* indexFile, const std::string& session)
+	: m_cacheDir(cacheDir),
+	  m_indexPath(cacheDir + indexFile),
+	  m_session(session),
+	  m_journalPath(m_indexPath + JOURNAL_SUFFIX),
+	  m_dirty(false),
+	  m_journalFd(-1),
+	  m_journalStale(false),
+	  m_journalFailed(false)
+{
+}
+
+StampIndex::~StampIndex()
+{
+	if (m_journalFd != -1)
+		close(m_journalFd);
+}
+
+void StampIndex::Load()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	m_stamps.clear();
+	m_dirty = false;
+
+	// the old scheme had no sessions
+	if (m_session.empty())
+		LoadLegacyStamps();
+
+	LoadIndex();
+
+	// what the last process got done after its last save
+	ReplayJournal();
+}
+
+void StampIndex::LoadIndex()
+{
+	int fd = open(m_indexPath.c_str(), O_RDONLY | O_NOATIME);
+	if (fd == -1) {
+		if (errno != ENOENT) {
+			LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+					PMLOGKS("index", m_indexPath.c_str()),
+					PMLOGKS("error", strerror(errno)),
+					"Failed to open stamp index %s: %s", m_indexPath.c_str(), strerror(errno));
+		}
+		return;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) == -1 || (size_t) info.st_size < sizeof(IndexHeader)) {
+		close(fd);
+		return;
+	}
+
+	const size_t length = info.st_size;
+	void *mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 1,
+				PMLOGKS("error", strerror(errno)),
+				"Failed to map stamp index %s: %s", m_indexPath.c_str(), strerror(errno));
+		return;
+	}
+
+	const char *data = static_cast<const char *>(mapped);
+	const char *end = data + length;
+	IndexHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+	    (header.version != INDEX_VERSION && header.version != SESSION_INDEX_VERSION)) {
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 1,
+				PMLOGKS("index", m_indexPath.c_str()),
+				"Ignoring stamp index %s with unknown format", m_indexPath.c_str());
+		munmap(mapped, length);
+		return;
+	}
+
+	const char *pos = data + sizeof(header);
+	std::string session;
+	if (header.version == SESSION_INDEX_VERSION) {
+		uint32_t sessionLength = 0;
+		if ((size_t)(end - pos) >= sizeof(sessionLength)) {
+			memcpy(&sessionLength, pos, sizeof(sessionLength));
+			pos += sizeof(sessionLength);
+		}
+		if ((size_t)(end - pos) < sessionLength)
+			sessionLength = 0;
+		session.assign(pos, sessionLength);
+		pos += sessionLength;
+	}
+	if (session != m_session) {
+		// nothing in it holds any more
+		LOG_DEBUG("Dropping the stamps of another session in %s", m_indexPath.c_str());
+		munmap(mapped, length);
+		m_dirty = true;
+		return;
+	}
+	for (uint32_t i = 0; i < header.count; i++) {
+		IndexEntry entry;
+		if ((size_t)(end - pos) < sizeof(entry))
+			break;
+		memcpy(&entry, pos, sizeof(entry));
+		pos += sizeof(entry);
+		if ((size_t)(end - pos) < entry.pathLength)
+			break;
+
+		Stamp& stamp = m_stamps[std::string(pos, entry.pathLength)];
+		stamp.mtime = entry.mtime;
+		stamp.mtimeNsec = entry.mtimeNsec;
+		stamp.size = entry.size;
+		stamp.hash = entry.hash;
+		pos += entry.pathLength;
+	}
+
+	if (m_stamps.size() != header.count) {
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 1,
+				PMLOGKS("index", m_indexPath.c_str()),
+				"Stamp index %s is truncated - recovered %zu of %u entries", m_indexPath.c_str(), m_stamps.size(), header.count);
+		m_dirty = true;
+	}
+
+	munmap(mapped, length);
+	LOG_DEBUG("Loaded %zu stamps from %s", m_stamps.size(), m_indexPath.c_str());
+}
+
+bool StampIndex::Save()
+{
+	LOG_TRACE("Entering function %s", __FUNCTION__);
+
+	if (!m_dirty && m_migratedStamps.empty())
+		return true;
+
+	std::string buffer;
+	IndexHeader header;
+	memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version = m_session.empty() ? INDEX_VERSION : SESSION_INDEX_VERSION;
+	header.count = m_stamps.size();
+	buffer.append(reinterpret_cast<const char *>(&header), sizeof(header));
+	if (!m_session.empty()) {
+		const uint32_t sessionLength = m_session.length();
+		buffer.append(reinterpret_cast<const char *>(&sessionLength), sizeof(sessionLength));
+		buffer.append(m_session);
+	}
+
+	for (StampMap::const_iterator i = m_stamps.begin(); i != m_stamps.end(); ++i) {
+		IndexEntry entry;
+		entry.mtime = i->second.mtime;
+		entry.mtimeNsec = i->second.mtimeNsec;
+		entry.size = i->second.size;
+		entry.hash = i->second.hash;
+		entry.pathLength = i->first.length();
+		buffer.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+		buffer.append(i->first);
+	}
+
+	if (!MappedFile::WriteAtomically(m_indexPath, buffer.data(), buffer.length()))
+		return false;
+
+	// all in the index now
+	ResetJournal();
+
+	// the migrated stamps are safely in the index now
+	for (LegacyStamps::const_iterator i = m_migratedStamps.begin(); i != m_migratedStamps.end(); ++i) {
+		unlink((m_cacheDir + *i).c_str());
+	}
+	m_migratedStamps.clear();
+	m_dirty = false;
+
+	LOG_DEBUG("Saved %zu stamps to %s", m_stamps.size(), m_indexPath.c_str());
+	return true;
+}
+
+bool StampIndex::Lookup(const std::string& confFile, Stamp& stamp)
+{
+	StampMap::const_iterator i = m_stamps.find(confFile);
+	if (i != m_stamps.end()) {
+		stamp = i->second;
+		return true;
+	}
+
+	return MigrateLegacyStamp(confFile, stamp);
+}
+
+void StampIndex::Mark(const std::string& confFile, const Stamp& stamp)
+{
+	m_stamps[confFile] = stamp;
+	m_dirty = true;
+	AppendJournal(JournalMark, confFile, stamp);
+}
+
+void StampIndex::Unmark(const std::string& confFile)
+{
+	if (m_stamps.erase(confFile) > 0) {
+		m_dirty = true;
+		Stamp none;
+		memset(&none, 0, sizeof(none));
+		AppendJournal(JournalUnmark, confFile, none);
+	}
+
+	LegacyStamps::iterator i = m_legacyStamps.find(LegacyStampName(confFile));
+	if (i != m_legacyStamps.end()) {
+		unlink((m_cacheDir + *i).c_str());
+		m_legacyStamps.erase(i);
+	}
+}
+
+bool StampIndex::Matches(const Stamp& stamp, const struct stat& info)
+{
+	return stamp.mtime == (int64_t) info.st_mtim.tv_sec &&
+		stamp.mtimeNsec == (uint32_t) info.st_mtim.tv_nsec &&
+		stamp.size == (int64_t) info.st_size;
+}
+
+void StampIndex::FromStat(const struct stat& info, uint64_t hash, Stamp& stamp)
+{
+	stamp.mtime = info.st_mtim.tv_sec;
+	stamp.mtimeNsec = info.st_mtim.tv_nsec;
+	stamp.size = info.st_size;
+	stamp.hash = hash;
+}
+
+uint64_t StampIndex::Hash(const char* data, size_t length)
+{
+	// 64-bit FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool StampIndex::HashFile(const std::string& filePath, uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.Open(filePath))
+		return false;
+
+	hash = Hash(file.Data(), file.Length());
+	return true;
+}
+
+std::string StampIndex::BootId()
+{
+	// procfs reports no size - read it the plain way
+	FILE *file = fopen("/proc/sys/kernel/random/boot_id", "r");
+	if (file == NULL)
+		return "";
+
+	char buffer[BOOT_ID_LENGTH];
+	std::string bootId;
+	if (fgets(buffer, sizeof(buffer), file) != NULL) {
+		bootId = buffer;
+		if (!bootId.empty() && bootId[bootId.length() - 1] == '\n')
+			bootId.erase(bootId.length() - 1);
+	}
+	fclose(file);
+	return bootId;
+}
+
+void StampIndex::ReplayJournal()
+{
+	MappedFile file;
+	if (!file.Open(m_journalPath, MappedFile::MapLarge))
+		return;
+
+	const char *data = file.Data();
+	const char *pos = data;
+	const char *end = data + file.Length();
+
+	JournalHeader header;
+	if (file.Length() < sizeof(header)) {
+		m_journalStale = true;
+		return;
+	}
+	memcpy(&header, pos, sizeof(header));
+	pos += sizeof(header);
+	if (memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || header.version != JOURNAL_VERSION ||
+	    (size_t)(end - pos) < header.sessionLength || std::string(pos, header.sessionLength) != m_session) {
+		LOG_DEBUG("Ignoring stamp journal %s of another session", m_journalPath.c_str());
+		m_journalStale = true;
+		return;
+	}
+	pos += header.sessionLength;
+
+	size_t replayed = 0;
+	for (;;) {
+		uint32_t op;
+		IndexEntry entry;
+		if ((size_t)(end - pos) < sizeof(op) + sizeof(entry))
+			break;
+		memcpy(&op, pos, sizeof(op));
+		memcpy(&entry, pos + sizeof(op), sizeof(entry));
+		if ((size_t)(end - pos) < sizeof(op) + sizeof(entry) + entry.pathLength)
+			break;
+		const std::string confFile(pos + sizeof(op) + sizeof(entry), entry.pathLength);
+		pos += sizeof(op) + sizeof(entry) + entry.pathLength;
+
+		if (op == JournalMark) {
+			Stamp& stamp = m_stamps[confFile];
+			stamp.mtime = entry.mtime;
+			stamp.mtimeNsec = entry.mtimeNsec;
+			stamp.size = entry.size;
+			stamp.hash = entry.hash;
+		} else {
+			m_stamps.erase(confFile);
+		}
+		replayed++;
+	}
+
+	// records after a torn one would never be read
+	if (pos != end && truncate(m_journalPath.c_str(), pos - data) == -1)
+		m_journalStale = true;
+
+	if (replayed > 0) {
+		LOG_DEBUG("Recovered %zu stamp changes of an interrupted run from %s", replayed, m_journalPath.c_str());
+		m_dirty = true;
+	}
+}
+
+void StampIndex::AppendJournal(JournalOp op, const std::string& confFile, const Stamp& stamp)
+{
+	if (m_journalFd == -1) {
+		if (m_journalFailed)
+			return;
+
+		m_journalFd = open(m_journalPath.c_str(), O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		struct stat info;
+		if (m_journalFd == -1 || fstat(m_journalFd, &info) == -1 ||
+		    ((m_journalStale || info.st_size == 0) && ftruncate(m_journalFd, 0) == -1)) {
+			LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+					PMLOGKS("journal", m_journalPath.c_str()),
+					PMLOGKS("error", strerror(errno)),
+					"Failed to open stamp journal %s: %s", m_journalPath.c_str(), strerror(errno));
+			CloseJournal();
+			return;
+		}
+
+		if (m_journalStale || info.st_size == 0) {
+			m_journalStale = false;
+
+			JournalHeader header;
+			memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+			header.version = JOURNAL_VERSION;
+			header.sessionLength = m_session.length();
+			std::string buffer(reinterpret_cast<const char *>(&header), sizeof(header));
+			buffer.append(m_session);
+			if (write(m_journalFd, buffer.data(), buffer.length()) != (ssize_t) buffer.length()) {
+				CloseJournal();
+				return;
+			}
+		}
+	}
+
+	// a single write - after a crash the record is either there or cut short
+	const uint32_t code = op;
+	IndexEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.mtime = stamp.mtime;
+	entry.mtimeNsec = stamp.mtimeNsec;
+	entry.size = stamp.size;
+	entry.hash = stamp.hash;
+	entry.pathLength = confFile.length();
+
+	std::string record(reinterpret_cast<const char *>(&code), sizeof(code));
+	record.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+	record.append(confFile);
+	ssize_t written;
+	do {
+		written = write(m_journalFd, record.data(), record.length());
+	} while (written == -1 && errno == EINTR);
+
+	if (written != (ssize_t) record.length()) {
+		LOG_WARNING(MSGID_CONFIGURATOR_WARNING, 2,
+				PMLOGKS("journal", m_journalPath.c_str()),
+				PMLOGKS("error", strerror(errno)),
+				"Failed to append to stamp journal %s: %s", m_journalPath.c_str(), strerror(errno));
+		// a partial record would hide the ones after it
+		CloseJournal();
+	}
+}
+
+void StampIndex::CloseJournal()
+{
+	// until the next save - whatever made it in is still replayed
+	if (m_journalFd != -1) {
+		close(m_journalFd);
+		m_journalFd = -1;
+	}
+	m_journalFailed = true;
+}
+
+void StampIndex::ResetJournal()
+{
+	if (m_journalFd != -1) {
+		close(m_journalFd);
+		m_journalFd = -1;
+	}
+	if (unlink(m_journalPath.c_str()) == 0 || errno == ENOENT)
+		m_journalStale = false;
+	m_journalFailed = false;
+}
+
+void StampIndex::LoadLegacyStamps()
+{
+	m_legacyStamps.clear();
+
+	DIR *dp = opendir(m_cacheDir.c_str());
+	if (dp == NULL)
+		return;
+
+	struct dirent *dirp;
+	while ((dirp = readdir(dp)) != NULL) {
+		// old stamps are the config path with '/' replaced by '_'
+		if (dirp->d_name[0] == '_')
+			m_legacyStamps.insert(dirp->d_name);
+	}
+	closedir(dp);
+
+	if (!m_legacyStamps.empty())
+		LOG_DEBUG("%zu stamps of the old format left to migrate in %s", m_legacyStamps.size(), m_cacheDir.c_str());
+}
+
+bool StampIndex::MigrateLegacyStamp(const std::string& confFile, Stamp& stamp)
+{
+	LegacyStamps::iterator i = m_legacyStamps.find(LegacyStampName(confFile));
+	if (i == m_legacyStamps.end())
+		return false;
+
+	const std::string name = *i;
+	m_legacyStamps.erase(i);
+
+	// old stamps inherited the mtime of the config (+1s) when it was configured
+	struct stat stampInfo, confInfo;
+	if (stat((m_cacheDir + name).c_str(), &stampInfo) == -1 ||
+	    stat(confFile.c_str(), &confInfo) == -1 ||
+	    stampInfo.st_mtime < confInfo.st_mtime) {
+		m_migratedStamps.insert(name);
+		return false;
+	}
+
+	uint64_t hash;
+	if (!HashFile(confFile, hash))
+		return false;
+
+	FromStat(confInfo, hash, stamp);
+	Mark(confFile, stamp);
+	m_migratedStamps.insert(name);
+
+	LOG_DEBUG("Migrated stamp '%s' for '%s' to the stamp index", name.c_str(), confFile.c_str());
+	return true;
+}
+
+std::string StampIndex::LegacyStampName(const std::string& confFile) const
+{
+	return Replace(confFile, "/", "_");
+}
@@ -0,0 +1,126 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef STAMPINDEX_H_
+#define STAMPINDEX_H_
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
+#include <string>
+
+/**
+ * Records which config files have been configured, keyed by the full path
+ * of the config file.  Replaces the old scheme of one empty stamp file per
+ * config in the cache directory: the whole index lives in a single file that
+ * is mapped once at startup and rewritten atomically by Save().
+ *
+ * Stamps left over from the old scheme are migrated the first time the
+ * corresponding config is looked up.
+ *
+ * An index can also be tied to a session (e.g. the boot id) for services
+ * whose state doesn't outlive it - the stamps of another session are
+ * dropped when it is loaded.
+ *
+ * Every change between two saves is also appended to a journal next to the
+ * index, so that a process killed in the middle of a run doesn't lose the
+ * stamps of what got configured.  Load() replays it and Save() folds it
+ * into the index again.
+ */
+class StampIndex
+{
+public:
+	struct Stamp {
+		int64_t  mtime;
+		uint32_t mtimeNsec;
+		int64_t  size;
+		uint64_t hash;
+	};
+
+	StampIndex(const std::string& cacheDir);
+	StampIndex(const std::string& cacheDir, const char* indexFile, const std::string& session);
+	~StampIndex();
+
+	const std::string& Session() const { return m_session; }
+
+	void Load();
+	bool Save();
+
+	bool Lookup(const std::string& confFile, Stamp& stamp);
+	void Mark(const std::string& confFile, const Stamp& stamp);
+	void Unmark(const std::string& confFile);
+
+	// whether stamp was taken from the file described by info
+	static bool Matches(const Stamp& stamp, const struct stat& info);
+	static void FromStat(const struct stat& info, uint64_t hash, Stamp& stamp);
+
+	static uint64_t Hash(const char* data, size_t length);
+	static bool     HashFile(const std::string& filePath, uint64_t& hash);
+
+	// identifies the running boot ("" if the kernel doesn't tell)
+	static std::string BootId();
+
+private:
+	typedef std::tr1::unordered_map<std::string, Stamp> StampMap;
+	typedef std::tr1::unordered_set<std::string> LegacyStamps;
+
+	static const char* const INDEX_FILE;
+	static const char        INDEX_MAGIC[8];
+	static const uint32_t    INDEX_VERSION;
+	static const uint32_t    SESSION_INDEX_VERSION; // followed by the session
+	static const size_t      BOOT_ID_LENGTH = 40;
+	static const char* const JOURNAL_SUFFIX;
+	static const char        JOURNAL_MAGIC[8];
+	static const uint32_t    JOURNAL_VERSION;
+
+	enum JournalOp {
+		JournalMark   = 1,
+		JournalUnmark = 2,
+	};
+
+	void LoadIndex();
+	void ReplayJournal();
+	void AppendJournal(JournalOp op, const std::string& confFile, const Stamp& stamp);
+	void CloseJournal();
+	void ResetJournal();
+
+	void LoadLegacyStamps();
+	bool MigrateLegacyStamp(const std::string& confFile, Stamp& stamp);
+	std::string LegacyStampName(const std::string& confFile) const;
+
+	const std::string m_cacheDir;
+	const std::string m_indexPath;
+	const std::string m_session;
+	const std::string m_journalPath;
+
+	StampMap m_stamps;
+
+	/**
+	 * Names of the per-config stamp files of the old scheme still present
+	 * in the cache directory (read once at startup).
+	 */
+	LegacyStamps m_legacyStamps;
+	LegacyStamps m_migratedStamps;
+
+	bool m_dirty;
+
+	int m_journalFd;      // opened by the first change after a save
+	bool m_journalStale;  // holds another session (or garbage) - start over
+	bool m_journalFailed; // don't try again for every change
+};
+
+#endif /* STAMPINDEX_H_ */